@@ -0,0 +1,123 @@
+#ifndef CANNY_COMMON_H
+#define CANNY_COMMON_H
+
+// Definitions shared by the CUDA (cuda_filter.cu) and CPU (cpu_filter.c)
+// Canny backends so both classify pixels identically.
+
+#include <string.h>
+
+#ifdef __CUDACC__
+#define CANNY_HOST_DEVICE __host__ __device__
+#else
+#define CANNY_HOST_DEVICE
+#endif
+
+#define STRONG_EDGE 255
+#define WEAK_EDGE   100
+
+// Double threshold defaults (CANNY_LOW / CANNY_HIGH override them)
+#define DEFAULT_LOW_THRESH  50
+#define DEFAULT_HIGH_THRESH 100
+
+// BT.601 luma weights in Q8. They sum to 256, so white stays 255 and the
+// rounded sum always fits in a byte.
+#define GRAY_WEIGHT_R 77
+#define GRAY_WEIGHT_G 150
+#define GRAY_WEIGHT_B 29
+
+static inline CANNY_HOST_DEVICE unsigned char gray_from_rgb(unsigned int r, unsigned int g, unsigned int b) {
+    return (unsigned char)((GRAY_WEIGHT_R * r + GRAY_WEIGHT_G * g + GRAY_WEIGHT_B * b + 128) >> 8);
+}
+
+// Gradient direction sectors used by non-maximum suppression
+#define SECTOR_HORIZONTAL 0   // angle in [0, 22.5) or [157.5, 180): compare left/right
+#define SECTOR_DIAG_UP    1   // angle in [22.5, 67.5): compare up-right/down-left
+#define SECTOR_VERTICAL   2   // angle in [67.5, 112.5): compare up/down
+#define SECTOR_DIAG_DOWN  3   // angle in [112.5, 157.5): compare up-left/down-right
+
+// tan(22.5°) and tan(67.5°) in Q15. Checked exhaustively against the
+// atan2f path for every Gx, Gy in [-1020, 1020] (the Sobel range of 8-bit input).
+#define TAN22_Q15 13573
+#define TAN67_Q15 79109
+
+// Integer replacement for atan2f + angle binning. Written as selects rather
+// than early returns so the CPU loops calling it vectorize.
+static inline CANNY_HOST_DEVICE unsigned char gradient_sector(int Gx, int Gy) {
+    int ax = Gx < 0 ? -Gx : Gx;
+    int ay = Gy < 0 ? -Gy : Gy;
+    int horizontal = (ay << 15) < TAN22_Q15 * ax || (ax | ay) == 0;
+    int vertical = (ay << 15) >= TAN67_Q15 * ax;
+    int diagonal = ((Gx ^ Gy) < 0) ? SECTOR_DIAG_DOWN : SECTOR_DIAG_UP;
+    return horizontal ? SECTOR_HORIZONTAL : (vertical ? SECTOR_VERTICAL : diagonal);
+}
+
+// -------------------- Automatic thresholds --------------------
+//
+// CANNY_THRESHOLDS picks how the double threshold is chosen:
+//   fixed       CANNY_LOW / CANNY_HIGH (default 50 / 100)
+//   otsu        high = Otsu split of the gradient-magnitude histogram, low = high / 2
+//   percentile  high = the magnitude below which CANNY_PERCENTILE % (default 70)
+//               of the nonzero magnitudes fall, low = 0.4 * high;
+//               CANNY_PERCENTILE=50 is the median rule. Flat regions are left
+//               out so they cannot drag high down to the noise level, and high
+//               is at least PERCENTILE_MIN_HIGH.
+// The histogram is filled by the Sobel stage, so the auto modes cost no
+// extra pass over the frame.
+
+#define THRESH_FIXED      0
+#define THRESH_OTSU       1
+#define THRESH_PERCENTILE 2
+
+#define MAG_BINS 256   // Sobel magnitudes are clamped to 0..255
+
+// Floor for the percentile high threshold, so a low-contrast frame whose
+// gradients are mostly sensor noise does not turn that noise into edges
+#define PERCENTILE_MIN_HIGH 20
+
+static inline int threshold_mode_from_name(const char* name) {
+    if (strcmp(name, "otsu") == 0) return THRESH_OTSU;
+    if (strcmp(name, "percentile") == 0) return THRESH_PERCENTILE;
+    return THRESH_FIXED;
+}
+
+// Pick low/high from a magnitude histogram. Thresholds are at least 1 so
+// flat frames (all magnitudes 0) produce no edges.
+static inline void thresholds_from_histogram(const unsigned int hist[MAG_BINS], int mode, int percentile,
+                                             unsigned char* low, unsigned char* high) {
+    double total = 0.0, weighted = 0.0;
+    for (int m = 0; m < MAG_BINS; m++) {
+        total += hist[m];
+        weighted += (double)m * hist[m];
+    }
+
+    int split = 0;   // magnitudes <= split are background
+    if (total > 0 && mode == THRESH_OTSU) {
+        double below = 0.0, below_weighted = 0.0, best = -1.0;
+        for (int m = 0; m < MAG_BINS - 1; m++) {
+            below += hist[m];
+            below_weighted += (double)m * hist[m];
+            double above = total - below;
+            if (below == 0 || above == 0) continue;
+            double diff = below_weighted / below - (weighted - below_weighted) / above;
+            double between = below * above * diff * diff;
+            if (between > best) {
+                best = between;
+                split = m;
+            }
+        }
+    } else if (total > hist[0]) {
+        double target = (total - hist[0]) * percentile / 100.0, seen = 0.0;
+        for (split = 1; split < MAG_BINS - 1; split++) {
+            seen += hist[split];
+            if (seen >= target) break;
+        }
+    }
+
+    int h = split + 1;
+    if (mode == THRESH_PERCENTILE && h < PERCENTILE_MIN_HIGH) h = PERCENTILE_MIN_HIGH;
+    int l = mode == THRESH_OTSU ? h / 2 : (h * 2) / 5;
+    *high = (unsigned char)(h > 255 ? 255 : h);
+    *low = (unsigned char)(l < 1 ? 1 : l);
+}
+
+#endif // CANNY_COMMON_H
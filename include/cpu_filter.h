@@ -0,0 +1,39 @@
+#ifndef CPU_FILTER_H
+#define CPU_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// -------------------- Host-only APIs --------------------
+
+// Set the number of threads used inside each frame: FILTER_THREADS if set,
+// else the node's cores split evenly between ranks_per_node MPI ranks (pass 0
+// outside MPI to keep the OpenMP default). Returns the count.
+int cpu_filter_init_threads(int ranks_per_node);
+
+// Demo filter: thresholded |dx| + |dy| on the first channel
+void simple_edge_filter(unsigned char* input, unsigned char* output, int w, int h, int c);
+
+// Main Canny edge detection on the CPU (same contract as cuda_canny).
+// Allocates its scratch memory on every call; use a context for streams.
+void cpu_canny(unsigned char* input, unsigned char* output,
+    int width, int height, int channels,
+    unsigned char* prev_edge);
+
+// Reusable Canny state: owns all scratch memory, sized up front for
+// max_width x max_height (0, 0 defers to the first frame) and grown only when
+// a larger frame or more threads show up. One context per calling thread.
+typedef struct cpu_canny_context cpu_canny_context;
+
+cpu_canny_context* cpu_canny_create(int max_width, int max_height);
+void cpu_canny_run(cpu_canny_context* ctx, unsigned char* input, unsigned char* output,
+    int width, int height, int channels,
+    unsigned char* prev_edge);
+void cpu_canny_destroy(cpu_canny_context* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CPU_FILTER_H
@@ -0,0 +1,62 @@
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Row kernels behind the CPU filters. The same source (cpu_kernels_impl.h)
+// is compiled once per instruction set; cpu_kernels() picks the best table
+// the host supports at startup, so one binary runs everywhere.
+
+typedef struct {
+    const char* name;
+
+    // RGB(A)/gray row -> gray row
+    void (*gray_row)(const unsigned char* in, unsigned char* out, int width, int channels);
+
+    // Separable 5x5 Gaussian: [1 4 6 4 1] horizontally into 16 bits, then
+    // vertically over five such rows with >> 8 (x in [2, width-2))
+    void (*blur_h_row)(const unsigned char* src, unsigned short* dst, int width);
+    void (*blur_v_row)(unsigned short* const rows[5], unsigned char* dst, int width);
+
+    // Sobel magnitude + direction sector, then NMS by sector (x in [1, width-1))
+    void (*sobel_sector_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                             unsigned char* mag, unsigned char* sector, int width);
+    void (*nms_sector_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                           const unsigned char* sector, unsigned char* out, int width);
+
+    // Double threshold over n pixels (may run in place)
+    void (*threshold_row)(const unsigned char* in, unsigned char* out, size_t n,
+                          unsigned char low_thresh, unsigned char high_thresh);
+
+    // simple_edge_filter on one interior row of interleaved input (x in [1, width-1))
+    void (*simple_edge_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                            unsigned char* out, int width, int channels);
+
+    // Edge wire encoding (edge_codec.c). Bits are LSB first: bit i % 8 of
+    // byte i / 8 is set when pixel i is nonzero; expanding gives 0/255.
+    void (*edge_bits)(const unsigned char* in, unsigned char* bits, size_t n);
+    void (*edge_expand)(const unsigned char* bits, unsigned char* out, size_t n);
+    // Length of the run at in whose pixels are all nonzero (edge) or all zero (!edge), at most n
+    size_t (*edge_run)(const unsigned char* in, size_t n, int edge);
+    // 1 when every pixel is 0 or 255
+    int (*edge_is_binary)(const unsigned char* in, size_t n);
+} cpu_kernel_table;
+
+extern const cpu_kernel_table cpu_kernels_scalar;
+extern const cpu_kernel_table cpu_kernels_sse41;
+extern const cpu_kernel_table cpu_kernels_avx2;
+extern const cpu_kernel_table cpu_kernels_avx512;
+
+// Best table for this host, chosen on first use via cpuid. CPU_ISA=scalar|
+// sse41|avx2|avx512 forces a lower level for benchmarking.
+const cpu_kernel_table* cpu_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CPU_KERNELS_H
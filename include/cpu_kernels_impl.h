@@ -0,0 +1,485 @@
+// Row kernels for the CPU filters, compiled once per instruction set.
+//
+// Each cpu_kernels_<isa>.c defines CPU_KERNEL_ISA and includes this file;
+// the Makefile builds it with the matching -m flags. Plain loops are marked
+// CPU_SIMD_LOOP so the compiler vectorizes them for that target, and the
+// hand-written paths below are enabled by the target macros (__AVX512BW__,
+// __AVX2__, __SSE4_1__) of the translation unit. All variants produce
+// bit-identical output.
+
+#ifndef CPU_KERNEL_ISA
+#error "define CPU_KERNEL_ISA before including cpu_kernels_impl.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "cpu_kernels.h"
+#include "canny_common.h"
+
+#ifdef CPU_KERNELS_SCALAR
+#define CPU_SIMD_LOOP
+#else
+#define CPU_SIMD_LOOP _Pragma("omp simd")
+#endif
+
+#define KERNEL_NAME2(name, isa) name##_##isa
+#define KERNEL_NAME1(name, isa) KERNEL_NAME2(name, isa)
+#define KERNEL(name) KERNEL_NAME1(name, CPU_KERNEL_ISA)
+
+// -------------------- Gray conversion --------------------
+//
+// gray_from_rgb() in Q8 fixed point. The SIMD paths bring every pixel into
+// a 32-bit r,g,b,x lane (4-channel input already is one; 3-channel input is
+// spread out with a byte shuffle), then a pair of 16-bit multiply-adds gives
+// 77r + 29b and 150g per lane. Each iteration converts 32 pixels.
+
+#if defined(__SSE4_1__)
+// Four r,g,b,x pixels -> four gray values in 32-bit lanes
+static inline __m128i gray_rgbx_128(__m128i px) {
+    __m128i rb = _mm_and_si128(px, _mm_set1_epi32(0x00ff00ff));
+    __m128i gx = _mm_srli_epi16(px, 8);
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(rb, _mm_set1_epi32(GRAY_WEIGHT_B << 16 | GRAY_WEIGHT_R)),
+                                _mm_madd_epi16(gx, _mm_set1_epi32(GRAY_WEIGHT_G)));
+    return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+}
+
+// Four packed r,g,b pixels (the first 12 of 16 loaded bytes) -> r,g,b,0
+static inline __m128i rgb_to_rgbx_128(__m128i v) {
+    return _mm_shuffle_epi8(v, _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+}
+
+// Sixteen gray values in 32-bit lanes -> 16 bytes
+static inline __m128i pack_gray_128(__m128i a, __m128i b, __m128i c, __m128i d) {
+    return _mm_packus_epi16(_mm_packus_epi32(a, b), _mm_packus_epi32(c, d));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i gray_rgbx_256(__m256i px) {
+    __m256i rb = _mm256_and_si256(px, _mm256_set1_epi32(0x00ff00ff));
+    __m256i gx = _mm256_srli_epi16(px, 8);
+    __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(rb, _mm256_set1_epi32(GRAY_WEIGHT_B << 16 | GRAY_WEIGHT_R)),
+                                   _mm256_madd_epi16(gx, _mm256_set1_epi32(GRAY_WEIGHT_G)));
+    return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+}
+
+// Eight packed r,g,b pixels (the first 24 of 32 loaded bytes) -> r,g,b,0:
+// move bytes 12..23 to the upper 128-bit lane, then shuffle within lanes
+static inline __m256i rgb_to_rgbx_256(__m256i v) {
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0));
+    return _mm256_shuffle_epi8(v, _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                   0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+}
+
+// Thirty-two gray values in 32-bit lanes -> 32 bytes. The packs work per
+// 128-bit lane, so the result is put back in order with one permute.
+static inline __m256i pack_gray_256(__m256i a, __m256i b, __m256i c, __m256i d) {
+    __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d));
+    return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+#endif
+
+#if defined(__AVX512BW__)
+static inline __m512i gray_rgbx_512(__m512i px) {
+    __m512i rb = _mm512_and_si512(px, _mm512_set1_epi32(0x00ff00ff));
+    __m512i gx = _mm512_srli_epi16(px, 8);
+    __m512i sum = _mm512_add_epi32(_mm512_madd_epi16(rb, _mm512_set1_epi32(GRAY_WEIGHT_B << 16 | GRAY_WEIGHT_R)),
+                                   _mm512_madd_epi16(gx, _mm512_set1_epi32(GRAY_WEIGHT_G)));
+    return _mm512_srli_epi32(_mm512_add_epi32(sum, _mm512_set1_epi32(128)), 8);
+}
+
+// Sixteen packed r,g,b pixels (48 bytes, read with a masked load) -> r,g,b,0
+static inline __m512i load_rgb_to_rgbx_512(const unsigned char* p) {
+    __m512i v = _mm512_maskz_loadu_epi8(0xffffffffffffULL, p);
+    v = _mm512_permutexvar_epi32(_mm512_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0), v);
+    return _mm512_shuffle_epi8(v, _mm512_broadcast_i32x4(
+        _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)));
+}
+#endif
+
+static void gray_row_c3(const unsigned char* in, unsigned char* out, int width) {
+    int x = 0;
+#if defined(__AVX512BW__)
+    for (; x + 32 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 3;
+        __m128i lo = _mm512_cvtepi32_epi8(gray_rgbx_512(load_rgb_to_rgbx_512(p)));
+        __m128i hi = _mm512_cvtepi32_epi8(gray_rgbx_512(load_rgb_to_rgbx_512(p + 48)));
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+#elif defined(__AVX2__)
+    // Each 32-byte load uses 24 bytes, so stop while 8 spare bytes remain
+    for (; x + 32 + 3 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 3;
+        __m256i g[4];
+        for (int k = 0; k < 4; k++) {
+            g[k] = gray_rgbx_256(rgb_to_rgbx_256(_mm256_loadu_si256((const __m256i*)(p + 24 * k))));
+        }
+        _mm256_storeu_si256((__m256i*)(out + x), pack_gray_256(g[0], g[1], g[2], g[3]));
+    }
+#elif defined(__SSE4_1__)
+    // Each 16-byte load uses 12 bytes, so stop while 4 spare bytes remain
+    for (; x + 32 + 2 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 3;
+        __m128i g[8];
+        for (int k = 0; k < 8; k++) {
+            g[k] = gray_rgbx_128(rgb_to_rgbx_128(_mm_loadu_si128((const __m128i*)(p + 12 * k))));
+        }
+        _mm_storeu_si128((__m128i*)(out + x), pack_gray_128(g[0], g[1], g[2], g[3]));
+        _mm_storeu_si128((__m128i*)(out + x + 16), pack_gray_128(g[4], g[5], g[6], g[7]));
+    }
+#endif
+    for (; x < width; x++) {
+        const unsigned char* p = in + (size_t)x * 3;
+        out[x] = gray_from_rgb(p[0], p[1], p[2]);
+    }
+}
+
+static void gray_row_c4(const unsigned char* in, unsigned char* out, int width) {
+    int x = 0;
+#if defined(__AVX512BW__)
+    for (; x + 32 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 4;
+        __m128i lo = _mm512_cvtepi32_epi8(gray_rgbx_512(_mm512_loadu_si512((const void*)p)));
+        __m128i hi = _mm512_cvtepi32_epi8(gray_rgbx_512(_mm512_loadu_si512((const void*)(p + 64))));
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+#elif defined(__AVX2__)
+    for (; x + 32 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 4;
+        __m256i g[4];
+        for (int k = 0; k < 4; k++) g[k] = gray_rgbx_256(_mm256_loadu_si256((const __m256i*)(p + 32 * k)));
+        _mm256_storeu_si256((__m256i*)(out + x), pack_gray_256(g[0], g[1], g[2], g[3]));
+    }
+#elif defined(__SSE4_1__)
+    for (; x + 32 <= width; x += 32) {
+        const unsigned char* p = in + (size_t)x * 4;
+        __m128i g[8];
+        for (int k = 0; k < 8; k++) g[k] = gray_rgbx_128(_mm_loadu_si128((const __m128i*)(p + 16 * k)));
+        _mm_storeu_si128((__m128i*)(out + x), pack_gray_128(g[0], g[1], g[2], g[3]));
+        _mm_storeu_si128((__m128i*)(out + x + 16), pack_gray_128(g[4], g[5], g[6], g[7]));
+    }
+#endif
+    for (; x < width; x++) {
+        const unsigned char* p = in + (size_t)x * 4;
+        out[x] = gray_from_rgb(p[0], p[1], p[2]);
+    }
+}
+
+// Gray row from 1 (copy), 2 (gray + alpha: first channel), 3 or 4 channels
+static void KERNEL(gray_row)(const unsigned char* in, unsigned char* out, int width, int channels) {
+    switch (channels) {
+    case 1:
+        memcpy(out, in, width);
+        break;
+    case 3:
+        gray_row_c3(in, out, width);
+        break;
+    case 4:
+        gray_row_c4(in, out, width);
+        break;
+    default:
+        for (int x = 0; x < width; x++) {
+            const unsigned char* p = in + (size_t)x * channels;
+            out[x] = channels < 3 ? p[0] : gray_from_rgb(p[0], p[1], p[2]);
+        }
+        break;
+    }
+}
+
+// Horizontal [1 4 6 4 1] pass of the separable 5x5 Gaussian (x in [2, width-2))
+static void KERNEL(blur_h_row)(const unsigned char* src, unsigned short* dst, int width) {
+    int x = 2;
+#if defined(__AVX512BW__)
+    for (; x + 32 <= width - 2; x += 32) {
+        __m512i p0 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x - 2)));
+        __m512i p1 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x - 1)));
+        __m512i p2 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x)));
+        __m512i p3 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x + 1)));
+        __m512i p4 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)(src + x + 2)));
+        __m512i sum = _mm512_add_epi16(p0, p4);
+        sum = _mm512_add_epi16(sum, _mm512_slli_epi16(_mm512_add_epi16(p1, p3), 2));
+        sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_slli_epi16(p2, 2), _mm512_slli_epi16(p2, 1)));
+        _mm512_storeu_si512((void*)(dst + x), sum);
+    }
+#endif
+#if defined(__AVX2__)
+    for (; x + 16 <= width - 2; x += 16) {
+        __m256i p0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x - 2)));
+        __m256i p1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x - 1)));
+        __m256i p2 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x)));
+        __m256i p3 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x + 1)));
+        __m256i p4 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + x + 2)));
+        __m256i sum = _mm256_add_epi16(p0, p4);
+        sum = _mm256_add_epi16(sum, _mm256_slli_epi16(_mm256_add_epi16(p1, p3), 2));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_slli_epi16(p2, 2), _mm256_slli_epi16(p2, 1)));
+        _mm256_storeu_si256((__m256i*)(dst + x), sum);
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; x + 8 <= width - 2; x += 8) {
+        __m128i p0 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + x - 2)));
+        __m128i p1 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + x - 1)));
+        __m128i p2 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + x)));
+        __m128i p3 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + x + 1)));
+        __m128i p4 = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + x + 2)));
+        __m128i sum = _mm_add_epi16(p0, p4);
+        sum = _mm_add_epi16(sum, _mm_slli_epi16(_mm_add_epi16(p1, p3), 2));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(p2, 2), _mm_slli_epi16(p2, 1)));
+        _mm_storeu_si128((__m128i*)(dst + x), sum);
+    }
+#endif
+    for (; x < width - 2; x++) {
+        dst[x] = src[x-2] + 4 * (src[x-1] + src[x+1]) + 6 * src[x] + src[x+2];
+    }
+}
+
+// Vertical [1 4 6 4 1] pass over five horizontal rows, then >> 8 (the sum of
+// all weights is 256, so the 16-bit accumulator cannot overflow)
+static void KERNEL(blur_v_row)(unsigned short* const rows[5], unsigned char* dst, int width) {
+    const unsigned short *r0 = rows[0], *r1 = rows[1], *r2 = rows[2], *r3 = rows[3], *r4 = rows[4];
+    int x = 2;
+#if defined(__AVX512BW__)
+    for (; x + 32 <= width - 2; x += 32) {
+        __m512i sum = _mm512_add_epi16(_mm512_loadu_si512((const void*)(r0 + x)),
+                                       _mm512_loadu_si512((const void*)(r4 + x)));
+        __m512i inner = _mm512_add_epi16(_mm512_loadu_si512((const void*)(r1 + x)),
+                                         _mm512_loadu_si512((const void*)(r3 + x)));
+        __m512i center = _mm512_loadu_si512((const void*)(r2 + x));
+        sum = _mm512_add_epi16(sum, _mm512_slli_epi16(inner, 2));
+        sum = _mm512_add_epi16(sum, _mm512_add_epi16(_mm512_slli_epi16(center, 2), _mm512_slli_epi16(center, 1)));
+        sum = _mm512_srli_epi16(sum, 8);
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm512_cvtepi16_epi8(sum));
+    }
+#endif
+#if defined(__AVX2__)
+    for (; x + 16 <= width - 2; x += 16) {
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r0 + x)),
+                                       _mm256_loadu_si256((const __m256i*)(r4 + x)));
+        __m256i inner = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(r1 + x)),
+                                         _mm256_loadu_si256((const __m256i*)(r3 + x)));
+        __m256i center = _mm256_loadu_si256((const __m256i*)(r2 + x));
+        sum = _mm256_add_epi16(sum, _mm256_slli_epi16(inner, 2));
+        sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_slli_epi16(center, 2), _mm256_slli_epi16(center, 1)));
+        sum = _mm256_srli_epi16(sum, 8);
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        _mm_storeu_si128((__m128i*)(dst + x), packed);
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; x + 8 <= width - 2; x += 8) {
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r0 + x)),
+                                    _mm_loadu_si128((const __m128i*)(r4 + x)));
+        __m128i inner = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r1 + x)),
+                                      _mm_loadu_si128((const __m128i*)(r3 + x)));
+        __m128i center = _mm_loadu_si128((const __m128i*)(r2 + x));
+        sum = _mm_add_epi16(sum, _mm_slli_epi16(inner, 2));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_slli_epi16(center, 2), _mm_slli_epi16(center, 1)));
+        sum = _mm_srli_epi16(sum, 8);
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(sum, sum));
+    }
+#endif
+    for (; x < width - 2; x++) {
+        dst[x] = (unsigned short)(r0[x] + 4 * (r1[x] + r3[x]) + 6 * r2[x] + r4[x]) >> 8;
+    }
+}
+
+// Sobel gradient magnitude + direction sector for one interior row
+static void KERNEL(sobel_sector_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                                     unsigned char* mag, unsigned char* sector, int width) {
+    mag[0] = 0;
+    mag[width - 1] = 0;
+    CPU_SIMD_LOOP
+    for (int x = 1; x < width - 1; x++) {
+        int Gx = -up[x-1] + up[x+1] - 2 * mid[x-1] + 2 * mid[x+1] - down[x-1] + down[x+1];
+        int Gy = -up[x-1] - 2 * up[x] - up[x+1] + down[x-1] + 2 * down[x] + down[x+1];
+
+        int m = (int)sqrtf((float)(Gx * Gx + Gy * Gy));
+        mag[x] = m < 255 ? m : 255;
+        sector[x] = gradient_sector(Gx, Gy);
+    }
+}
+
+// Non-maximum suppression for one interior row, neighbours picked by sector
+static void KERNEL(nms_sector_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                                   const unsigned char* sector, unsigned char* out, int width) {
+    out[0] = 0;
+    out[width - 1] = 0;
+    CPU_SIMD_LOOP
+    for (int x = 1; x < width - 1; x++) {
+        int s = sector[x];
+        unsigned char left = mid[x - 1], right = mid[x + 1];
+        unsigned char up_left = up[x - 1], up_mid = up[x], up_right = up[x + 1];
+        unsigned char down_left = down[x - 1], down_mid = down[x], down_right = down[x + 1];
+        unsigned char m1 = s == SECTOR_HORIZONTAL ? right : s == SECTOR_DIAG_UP ? up_right
+                         : s == SECTOR_VERTICAL ? up_mid : up_left;
+        unsigned char m2 = s == SECTOR_HORIZONTAL ? left : s == SECTOR_DIAG_UP ? down_left
+                         : s == SECTOR_VERTICAL ? down_mid : down_right;
+        out[x] = (mid[x] >= m1 && mid[x] >= m2) ? mid[x] : 0;
+    }
+}
+
+// Double thresholding over n pixels (may run in place)
+static void KERNEL(threshold_row)(const unsigned char* in, unsigned char* out, size_t n,
+                                  unsigned char low_thresh, unsigned char high_thresh) {
+    CPU_SIMD_LOOP
+    for (size_t i = 0; i < n; i++) {
+        unsigned char val = in[i];
+        out[i] = val >= high_thresh ? STRONG_EDGE : (val >= low_thresh ? WEAK_EDGE : 0);
+    }
+}
+
+// simple_edge_filter on one interior row: |dx| + |dy| of the first channel > 100
+static void KERNEL(simple_edge_row)(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                                    unsigned char* out, int width, int channels) {
+    out[0] = 0;
+    out[width - 1] = 0;
+    CPU_SIMD_LOOP
+    for (int x = 1; x < width - 1; x++) {
+        int gx = mid[(x+1) * channels] - mid[(x-1) * channels];
+        int gy = down[x * channels] - up[x * channels];
+        int mag = abs(gx) + abs(gy);
+        out[x] = (mag > 100) ? 255 : 0;
+    }
+}
+
+// -------------------- Edge wire encoding --------------------
+//
+// Vector compares against zero give one mask bit per pixel in pixel order,
+// which is exactly the LSB-first bit layout, so packing is a compare plus a
+// store of the mask and runs end at the first set bit of a mask.
+
+static void KERNEL(edge_bits)(const unsigned char* in, unsigned char* bits, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(in + i));
+        unsigned long long m = _mm512_test_epi8_mask(v, v);
+        memcpy(bits + i / 8, &m, 8);
+    }
+#elif defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        unsigned int m = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        memcpy(bits + i / 8, &m, 4);
+    }
+#elif defined(__SSE4_1__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        unsigned short m = (unsigned short)~_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        memcpy(bits + i / 8, &m, 2);
+    }
+#endif
+    for (; i < n; i += 8) {
+        unsigned char byte = 0;
+        for (size_t b = 0; b < 8 && i + b < n; b++) byte |= (in[i + b] != 0) << b;
+        bits[i / 8] = byte;
+    }
+}
+
+static void KERNEL(edge_expand)(const unsigned char* bits, unsigned char* out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    for (; i + 64 <= n; i += 64) {
+        unsigned long long m;
+        memcpy(&m, bits + i / 8, 8);
+        _mm512_storeu_si512((void*)(out + i), _mm512_movm_epi8(m));
+    }
+#elif defined(__AVX2__)
+    // Copy mask byte k to output bytes 8k..8k+7, then test one bit in each
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bit = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+    for (; i + 32 <= n; i += 32) {
+        int m;
+        memcpy(&m, bits + i / 8, 4);
+        __m256i v = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32(m), spread), bit);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_cmpeq_epi8(v, bit));
+    }
+#elif defined(__SSE4_1__)
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bit = _mm_set1_epi64x((long long)0x8040201008040201ULL);
+    for (; i + 16 <= n; i += 16) {
+        unsigned short m;
+        memcpy(&m, bits + i / 8, 2);
+        __m128i v = _mm_and_si128(_mm_shuffle_epi8(_mm_set1_epi16((short)m), spread), bit);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_cmpeq_epi8(v, bit));
+    }
+#endif
+    for (; i < n; i++) out[i] = (bits[i / 8] >> (i % 8)) & 1 ? 255 : 0;
+}
+
+static size_t KERNEL(edge_run)(const unsigned char* in, size_t n, int edge) {
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(in + i));
+        unsigned long long stop = edge ? _mm512_testn_epi8_mask(v, v) : _mm512_test_epi8_mask(v, v);
+        if (stop) return i + __builtin_ctzll(stop);
+    }
+#elif defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        unsigned int zero = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        unsigned int stop = edge ? zero : ~zero;
+        if (stop) return i + __builtin_ctz(stop);
+    }
+#elif defined(__SSE4_1__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        unsigned int zero = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        unsigned int stop = (edge ? zero : ~zero) & 0xffff;
+        if (stop) return i + __builtin_ctz(stop);
+    }
+#endif
+    while (i < n && (in[i] != 0) == edge) i++;
+    return i;
+}
+
+static int KERNEL(edge_is_binary)(const unsigned char* in, size_t n) {
+    // 0 and 255 are the only values with (unsigned char)(v + 1) <= 1
+    size_t i = 0;
+#if defined(__AVX512BW__)
+    for (; i + 64 <= n; i += 64) {
+        __m512i v = _mm512_add_epi8(_mm512_loadu_si512((const void*)(in + i)), _mm512_set1_epi8(1));
+        if (_mm512_cmpgt_epu8_mask(v, _mm512_set1_epi8(1))) return 0;
+    }
+#elif defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i one = _mm256_set1_epi8(1);
+        __m256i v = _mm256_add_epi8(_mm256_loadu_si256((const __m256i*)(in + i)), one);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, one), one)) != -1) return 0;
+    }
+#elif defined(__SSE4_1__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i one = _mm_set1_epi8(1);
+        __m128i v = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(in + i)), one);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, one), one)) != 0xffff) return 0;
+    }
+#endif
+    for (; i < n; i++) {
+        if ((unsigned char)(in[i] + 1) > 1) return 0;
+    }
+    return 1;
+}
+
+#define STRINGIFY2(x) #x
+#define STRINGIFY(x) STRINGIFY2(x)
+
+const cpu_kernel_table KERNEL(cpu_kernels) = {
+    STRINGIFY(CPU_KERNEL_ISA),
+    KERNEL(gray_row),
+    KERNEL(blur_h_row),
+    KERNEL(blur_v_row),
+    KERNEL(sobel_sector_row),
+    KERNEL(nms_sector_row),
+    KERNEL(threshold_row),
+    KERNEL(simple_edge_row),
+    KERNEL(edge_bits),
+    KERNEL(edge_expand),
+    KERNEL(edge_run),
+    KERNEL(edge_is_binary),
+};
@@ -12,8 +12,22 @@ void cuda_canny(unsigned char* input, unsigned char* output,
     int width, int height, int channels,
     unsigned char* prev_edge);
 
+// Reusable Canny state: owns all device scratch memory, sized up front for
+// max_width x max_height (0, 0 defers to the first frame) and grown only when
+// a larger frame shows up. cuda_canny / cuda_segment allocate and free a
+// context on every call; use the _run variants for streams of frames.
+typedef struct cuda_canny_context cuda_canny_context;
+
+cuda_canny_context* cuda_canny_create(int max_width, int max_height);
+void cuda_canny_run(cuda_canny_context* ctx, unsigned char* input, unsigned char* output,
+    int width, int height, int channels,
+    unsigned char* prev_edge);
+void cuda_canny_destroy(cuda_canny_context* ctx);
+
 // Grayscale threshold segmentation
 void cuda_segment(unsigned char* input, unsigned char* output_mask, int w, int h, int c, unsigned char threshold);
+void cuda_segment_run(cuda_canny_context* ctx, unsigned char* input, unsigned char* output_mask,
+    int w, int h, int c, unsigned char threshold);
 
 // Connected Components
 void cuda_connected_components(unsigned char* binary_input, int* host_labels, int width, int height);
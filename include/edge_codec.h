@@ -0,0 +1,37 @@
+#ifndef EDGE_CODEC_H
+#define EDGE_CODEC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compact wire encoding of edge maps for the worker -> master -> worker
+// relay. An encoded map is one method byte followed by:
+//
+//   EDGE_WIRE_RAW   the pixels as they are (maps with values besides 0 and 255)
+//   EDGE_WIRE_BITS  (pixels + 7) / 8 bytes, 1 bit per pixel, LSB first
+//   EDGE_WIRE_RUNS  run lengths as LEB128 varints, alternating zero and
+//                   nonzero runs, starting with a (possibly empty) zero run
+//
+// Binary maps are sent as whichever of BITS and RUNS is smaller, and decode
+// back to the same 0/255 bytes. Packing, unpacking and run scanning use the
+// SIMD kernels from cpu_kernels().
+
+enum { EDGE_WIRE_RAW = 0, EDGE_WIRE_BITS = 1, EDGE_WIRE_RUNS = 2 };
+
+// Largest possible encoding of a map with this many pixels
+size_t edge_encode_bound(size_t pixels);
+
+// Encode into out (edge_encode_bound bytes); returns the encoded size
+size_t edge_encode(const unsigned char* edges, size_t pixels, unsigned char* out);
+
+// Decode size bytes into pixels bytes of edges; 0, or -1 if malformed
+int edge_decode(const unsigned char* in, size_t size, unsigned char* edges, size_t pixels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EDGE_CODEC_H
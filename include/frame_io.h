@@ -1,13 +1,92 @@
 #ifndef FRAME_IO_H
 #define FRAME_IO_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_pool.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Decode an image file, or return frame <index> of a frame pack when the name
+// is "<pack>#<index>" (a read-only pointer into the mapping, no copy).
+// Release either kind with free_image.
 unsigned char* load_image(const char* filename, int* width, int* height, int* channels);
+void free_image(unsigned char* img);
 void save_image(const char* filename, const unsigned char* data, int width, int height, int channels);
 
+// load_image, decoding into buffers from pool instead of fresh allocations:
+// the image is 64-byte aligned and, once the pool has seen a frame of the
+// stream's size, decoding allocates nothing. Pack frames are still returned
+// in place. Release with free_pooled_image on the same pool.
+unsigned char* load_image_pooled(frame_pool* pool, const char* filename, int* width, int* height, int* channels);
+void free_pooled_image(frame_pool* pool, unsigned char* img);
+
+// Input frames for the drivers: printf pattern taking the frame index.
+// FRAME_PACK=<file> reads that pack, otherwise FRAME_PATTERN (default
+// frames/frame_%04d.jpg).
+const char* frame_input_pattern(void);
+
+// Frame count of the FRAME_PACK pack, or -1 when reading JPEG files
+int frame_input_pack_count(void);
+
+// Edge map output, in the format named by OUTPUT_FORMAT:
+//   jpg      quality-100 JPEG (default)
+//   pgm      8-bit binary PGM, lossless
+//   pbm      1-bit binary PBM; pixels >= 128 are edges, drawn white
+//   raw      width*height bytes, no header
+//   bitpack  every frame at 1 bit per pixel in a single <dir>/edges.bitpack
+typedef enum { EDGE_FORMAT_JPG, EDGE_FORMAT_PGM, EDGE_FORMAT_PBM, EDGE_FORMAT_RAW, EDGE_FORMAT_BITPACK } edge_format;
+
+edge_format edge_output_format(void);
+
+// File that frame index of pattern is written to. pattern is a printf
+// pattern without extension, e.g. "output/output_serial/frame_%04d".
+void edge_output_path(char* path, size_t size, const char* pattern, int index);
+
+// Save a 1-channel edge map as frame index of pattern; 0, or -1 on error
+int save_edges(const char* pattern, int index, const unsigned char* edges, int width, int height);
+
+// Packing buffer for the 1-bit formats (pbm, bitpack). A thread that saves
+// many frames keeps one, so packing only allocates when the frame size grows.
+typedef struct {
+    unsigned char* bits;
+    size_t capacity;
+} edge_scratch;
+
+// save_edges, packing into scratch
+int save_edges_scratch(edge_scratch* scratch, const char* pattern, int index, const unsigned char* edges,
+                       int width, int height);
+void edge_scratch_free(edge_scratch* scratch);
+
+// Start a run that saves edge maps to pattern. With OUTPUT_FORMAT=bitpack
+// the container is truncated, so no frame of an earlier run survives. Call
+// once per run before any process saves a frame: the MPI drivers call it on
+// rank 0 before the startup barrier, since every rank writes the same file.
+void edge_output_begin(const char* pattern);
+
+// This process has saved its last frame: with OUTPUT_FORMAT=bitpack the
+// header's frame count is raised to cover every frame it wrote, and the
+// container is closed
+void edge_output_end(void);
+
+// Pack n pixels MSB first at 1 bit per pixel (>= 128 -> 1) into (n + 7) / 8 bytes
+void pack_edge_bits(const unsigned char* in, unsigned char* out, int n);
+
+// edges.bitpack: this header, then frame i at sizeof(header) + i * frame_bytes.
+// Rows start on byte boundaries, as in PBM. Processes write their frames in
+// place; frames 0..frame_count-1 are from the run that wrote the file, and a
+// frame the run did not produce (a gap in a manifest) reads as zeros.
+#define EDGE_PACK_MAGIC "EDGEPAK2"
+
+typedef struct {
+    char magic[8];
+    uint32_t width, height;
+    uint64_t frame_bytes;     // height * ((width + 7) / 8)
+    uint64_t frame_count;     // highest frame index written + 1, set as writers finish
+} edge_pack_header;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,55 @@
+#ifndef FRAME_PACK_H
+#define FRAME_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame pack: every frame of a video as raw pixels in one file, so repeated
+// runs skip the JPEG decode and the per-frame file open.
+//
+//   [header, padded to FRAME_PACK_ALIGN] [frame 0] [frame 1] ...
+//
+// All frames share width, height and channels; each one starts on a
+// FRAME_PACK_ALIGN boundary so pointers into the mapping are SIMD aligned.
+
+#define FRAME_PACK_MAGIC "FRMPACK1"
+#define FRAME_PACK_ALIGN 4096
+
+typedef struct {
+    char magic[8];            // FRAME_PACK_MAGIC
+    uint32_t width, height, channels;
+    uint32_t frame_count;
+    uint64_t frame_stride;    // bytes from one frame to the next
+    uint64_t data_offset;     // offset of frame 0
+} frame_pack_header;
+
+typedef struct {
+    frame_pack_header header;
+    const unsigned char* base;   // read-only mapping of the whole file
+    size_t size;
+} frame_pack;
+
+// Map a pack read-only; NULL (after logging) if it is missing or malformed
+frame_pack* frame_pack_open(const char* path);
+void frame_pack_close(frame_pack* pack);
+
+// Pointer to frame index inside the mapping (NULL if out of range). The
+// pages are read on first touch; nothing is copied.
+const unsigned char* frame_pack_frame(const frame_pack* pack, int index);
+
+// Writing: create, append frames of the given size in order, finish
+typedef struct frame_pack_writer frame_pack_writer;
+
+frame_pack_writer* frame_pack_create(const char* path, int width, int height, int channels);
+int frame_pack_append(frame_pack_writer* writer, const unsigned char* pixels);
+int frame_pack_finish(frame_pack_writer* writer);   // writes the frame count; returns it (-1 on error)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_PACK_H
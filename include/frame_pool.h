@@ -0,0 +1,44 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pool of 64-byte aligned frame-sized buffers. A decode loop asks for the
+// same few sizes every frame; recycling them keeps those allocations out of
+// malloc, which would otherwise mmap/munmap them (and fault their pages in
+// again) each time. Safe to use from several threads.
+
+#define FRAME_POOL_ALIGN 64
+
+typedef struct frame_pool frame_pool;
+
+typedef struct {
+    long hits;          // requests served by a recycled buffer
+    long misses;        // requests that had to allocate
+    int buffers;        // buffers owned by the pool
+    size_t bytes;       // their total size
+} frame_pool_stats;
+
+frame_pool* frame_pool_create(void);
+void frame_pool_destroy(frame_pool* pool);   // buffers still handed out must have been put back
+
+// Buffer of at least bytes, reusing the smallest free one that fits
+void* frame_pool_get(frame_pool* pool, size_t bytes);
+
+// Return a buffer from frame_pool_get; 0 (and nothing done) if it is not one
+int frame_pool_put(frame_pool* pool, void* buf);
+
+frame_pool_stats frame_pool_get_stats(frame_pool* pool);
+
+// Log the counters as "<tag>: Frame pool ..."
+void frame_pool_log(frame_pool* pool, const char* tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,43 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Background edge-map writer: a pool of encoder threads behind a bounded queue,
+// so the JPEG encode is taken off the caller's critical path. The caller
+// fills a buffer from the writer, hands it back and moves on; it only blocks
+// when the backlog is full. The buffers are recycled, so steady-state output
+// allocates nothing.
+
+typedef struct frame_writer frame_writer;
+
+// threads encoders sharing a backlog of up to depth queued images
+frame_writer* frame_writer_create(int threads, int depth);
+
+// Same, sized from WRITER_THREADS (default 2) and WRITER_DEPTH (default 4)
+frame_writer* frame_writer_from_env(void);
+
+// A width*height output buffer from the writer's fixed set of depth +
+// threads + 1: the queued maps, those being written and the one being filled.
+// Blocks while all of them are out.
+unsigned char* frame_writer_buffer(frame_writer* writer, int width, int height);
+
+// Queue an edge map from frame_writer_buffer for save_edges(pattern, index,
+// ...). The writer takes it back once written; blocks while depth maps are
+// already waiting.
+void frame_writer_submit(frame_writer* writer, const char* pattern, int index, unsigned char* edges,
+                         int width, int height);
+
+// Wait until every submitted image has been written
+void frame_writer_flush(frame_writer* writer);
+
+// Flush, stop the threads and log the encode time; tag prefixes the log line
+void frame_writer_destroy(frame_writer* writer, const char* tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_WRITER_H
@@ -0,0 +1,56 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "y4m.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Three-stage decode -> process -> encode frame pipeline. Decoder and encoder
+// threads are connected to the compute stage (the calling thread) by bounded
+// queues, so throughput is set by the slowest stage instead of their sum.
+
+// One frame travelling through the pipeline
+typedef struct {
+    int index;
+    unsigned char* img;      // decoded input (filled by the decoder)
+    unsigned char* edges;    // w*h edge map (provided by the pipeline, filled by process)
+    int width, height, channels;
+} frame_job;
+
+typedef struct {
+    int total_frames;             // ignored when reading input_stream
+    const char* input_pattern;    // printf pattern taking the frame index
+    const char* output_pattern;   // without extension: OUTPUT_FORMAT adds it (see save_edges)
+    y4m_reader* input_stream;     // read frames (Y plane, 1 channel) from here instead of input_pattern
+    y4m_writer* output_stream;    // write edge maps here instead of output_pattern
+    const char* tag;              // log prefix, e.g. "SERIAL"
+    int depth;                    // queue depth; 0 runs the three stages inline
+    int decoders;                 // decoder threads
+    int encoders;                 // encoder threads
+    void (*process)(frame_job* job, void* arg);   // must fill job->edges
+    void* process_arg;
+} pipeline_config;
+
+// Fill depth / decoders / encoders from PIPELINE_DEPTH (default 4),
+// PIPELINE_DECODERS (1) and PIPELINE_ENCODERS (2), and open the Y4M_INPUT /
+// Y4M_OUTPUT streams ("-" for stdin / stdout) when set. Returns -1 if a
+// requested stream cannot be opened.
+int pipeline_config_from_env(pipeline_config* cfg);
+
+// Close the streams opened by pipeline_config_from_env; -1 (after logging)
+// if the Y4M output could not be completed
+int pipeline_close_streams(pipeline_config* cfg);
+
+// Run every frame through the pipeline; returns the number of frames saved,
+// or -1 (after logging) if the Y4M output failed, which stops the run.
+// Streams are sequential, so a stream input runs one decoder and a stream
+// output one encoder (which also keeps the output in input order).
+int run_frame_pipeline(const pipeline_config* cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIPELINE_H
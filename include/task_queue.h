@@ -1,16 +1,48 @@
 #ifndef TASK_QUEUE_H
 #define TASK_QUEUE_H
 
-#define MAX_TASKS 5000
 #define MAX_FILENAME_LEN 256
 
+// Frames are addressed by index; workers turn an index into an input with
+// frame_input_pattern() (a JPEG file or a frame in the FRAME_PACK pack).
+// The queue stores runs of consecutive indices, so a contiguous video of any
+// length is a single run and costs nothing to set up.
 typedef struct {
-    char filenames[MAX_TASKS][MAX_FILENAME_LEN];
+    int first, count;
+} frame_range;
+
+typedef struct {
+    frame_range* ranges;      // runs in dispatch order: ascending, disjoint
+    int num_ranges, capacity;
     int total_tasks;
-    int current_index;
+    int current_index;        // tasks handed out so far
+    int range_index, offset;  // next task: ranges[range_index].first + offset
+    int min_chunk, max_chunk; // bounds of a guided chunk
 } TaskQueue;
 
+// Fill the queue from the first source that is set:
+//   FRAME_PACK=<file>        frames 0..count-1 of the pack
+//   FRAME_LAST=<n>           frames FRAME_FIRST (default 0) .. n, not checked on disk;
+//                            both must be whole numbers >= 0, or nothing is queued
+//   FRAME_MANIFEST=<file>    one index or "first-last" range per line, '#' comments;
+//                            malformed lines are logged and skipped
+//   otherwise                every frames/frame_<n>.jpg with n >= 0
+// Frames are dispatched in index order and each frame is queued once, however
+// often the manifest or the directory names it.
+// Chunks are TASK_CHUNK_MIN (default 1) to TASK_CHUNK (default 16) frames.
 void init_task_queue(TaskQueue* queue);
-const char* get_next_task(TaskQueue* queue);
+void free_task_queue(TaskQueue* queue);
+
+// Guided scheduling: about remaining / (2 * workers) frames, clamped to
+// [min_chunk, max_chunk], so chunks shrink as the job nears its end and
+// the last frames are spread over every worker
+int guided_chunk_size(int remaining, int workers, int min_chunk, int max_chunk);
+
+// Hand out the next chunk of consecutive frames for one of workers workers:
+// returns its length (0 once every task is out) and stores its first frame
+int get_next_chunk(TaskQueue* queue, int workers, int* first);
+
+// Whether frame is in the job, dispatched or not
+int task_queue_contains(const TaskQueue* queue, int frame);
 
 #endif
@@ -8,11 +8,15 @@
 #define TAG_EDGE_REQUEST     5
 #define TAG_EDGE_DATA        6
 #define TAG_EDGE_DIMS        7
+#define TAG_PEER_REQUEST     8   // worker -> worker: frame whose edges it needs
+#define TAG_PEER_DIMS        9
+#define TAG_PEER_DATA        10
 #define MAX_FILENAME_LEN     256
-#define EDGE_TAG             99
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 
 
@@ -36,4 +40,23 @@ static inline void log_error(const char* fmt, ...) {
     va_end(args);
 }
 
+// Runtime settings are read from the environment so they pass through mpirun -x
+
+static inline const char* env_str(const char* name, const char* fallback) {
+    const char* value = getenv(name);
+    return (value && *value) ? value : fallback;
+}
+
+static inline int env_int(const char* name, int fallback) {
+    const char* value = getenv(name);
+    return (value && *value) ? atoi(value) : fallback;
+}
+
+// Wall-clock seconds (clock() adds up CPU time across threads)
+static inline double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// YUV4MPEG2 (Y4M) streams: a one-line header followed by "FRAME\n" and the
+// raw planes of each frame. ffmpeg reads and writes them through pipes
+// (-f yuv4mpegpipe), so frames can flow in and out without per-frame files.
+//
+// Only the Y plane is used: it is the luma the edge detector would compute
+// from RGB anyway, so it is handed over as a 1-channel image and the chroma
+// planes are skipped.
+
+typedef struct {
+    FILE* file;
+    int width, height;
+    char frame_rate[32];        // "num:den" from the F tag ("30:1" if absent)
+    size_t chroma_bytes;        // bytes after the Y plane in every frame
+    unsigned char* chroma;      // scratch the chroma planes are read into
+    int frames;                 // frames read so far
+} y4m_reader;
+
+typedef struct {
+    FILE* file;
+    int width, height;          // set by the first frame
+    char frame_rate[32];
+    unsigned char* chroma;      // neutral (128) 4:2:0 chroma planes
+    int frames;                 // frames written so far
+} y4m_writer;
+
+// Open a stream for reading; "-" is stdin. Supports 8-bit 4:2:0, 4:2:2,
+// 4:4:4 and mono. NULL (after logging) on a missing file or bad header.
+y4m_reader* y4m_open_read(const char* path);
+
+// Read the next frame's Y plane (width*height bytes) into luma.
+// Returns 1 on success, 0 at end of stream, -1 on a truncated or bad frame.
+int y4m_read_frame(y4m_reader* reader, unsigned char* luma);
+void y4m_close_read(y4m_reader* reader);
+
+// Open a stream for writing; "-" is stdout, in which case stdout itself is
+// pointed at stderr so log lines cannot corrupt the stream. The header is
+// written with the first frame; frame_rate may be NULL for 30:1.
+y4m_writer* y4m_open_write(const char* path, const char* frame_rate);
+
+// Append a gray image as a 4:2:0 frame with neutral chroma. Every frame must
+// have the size of the first one. Returns 0, or -1 on a write error.
+int y4m_write_gray(y4m_writer* writer, const unsigned char* gray, int width, int height);
+
+// Flush and close; returns 0, or -1 if anything failed to reach the output
+int y4m_close_write(y4m_writer* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // Y4M_H
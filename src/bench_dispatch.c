@@ -0,0 +1,147 @@
+// Task dispatch microbenchmark: every worker asks rank 0 for a task
+// (TAG_TASK_REQUEST) and times how long the answer (TAG_TASK_SEND) takes to
+// arrive. Rank 0 answers either the way run_master does, from pre-posted
+// receives and MPI_Waitsome (DISPATCH_MODE=event, default), or with the
+// MPI_Iprobe + usleep(1000) loop it used before (DISPATCH_MODE=poll).
+//
+//   mpirun -np 64 ./bin/bench_dispatch
+//
+// BENCH_TASKS round trips per worker (default 200); BENCH_WORK_US of busy
+// work between them (default 0) spreads the requests out like real frames.
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "utils.h"
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double cpu_seconds(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// Answer every request with the next task number, then -1 once per worker
+static void dispatch_poll(int world_size, int total_tasks) {
+    int next = 0, finished = 0;
+    while (finished < world_size - 1) {
+        MPI_Status status;
+        int flag;
+        MPI_Iprobe(MPI_ANY_SOURCE, TAG_TASK_REQUEST, MPI_COMM_WORLD, &flag, &status);
+        if (!flag) {
+            usleep(1000);
+            continue;
+        }
+        int dummy;
+        MPI_Recv(&dummy, 1, MPI_INT, status.MPI_SOURCE, TAG_TASK_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        int task = next < total_tasks ? next++ : -1;
+        if (task < 0) finished++;
+        MPI_Send(&task, 1, MPI_INT, status.MPI_SOURCE, TAG_TASK_SEND, MPI_COMM_WORLD);
+    }
+}
+
+static void dispatch_event(int world_size, int total_tasks) {
+    int workers = world_size - 1;
+    MPI_Request* requests = malloc(workers * sizeof(MPI_Request));
+    int* inbox = malloc(workers * sizeof(int));
+    int* completed = malloc(workers * sizeof(int));
+    for (int i = 0; i < workers; i++) {
+        MPI_Irecv(&inbox[i], 1, MPI_INT, i + 1, TAG_TASK_REQUEST, MPI_COMM_WORLD, &requests[i]);
+    }
+
+    int next = 0, finished = 0;
+    while (finished < workers) {
+        int num_completed;
+        MPI_Waitsome(workers, requests, &num_completed, completed, MPI_STATUSES_IGNORE);
+        for (int c = 0; c < num_completed; c++) {
+            int w = completed[c];
+            int task = next < total_tasks ? next++ : -1;
+            MPI_Send(&task, 1, MPI_INT, w + 1, TAG_TASK_SEND, MPI_COMM_WORLD);
+            if (task < 0)
+                finished++;
+            else
+                MPI_Irecv(&inbox[w], 1, MPI_INT, w + 1, TAG_TASK_REQUEST, MPI_COMM_WORLD, &requests[w]);
+        }
+    }
+    free(completed);
+    free(inbox);
+    free(requests);
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, world_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    if (world_size < 2) {
+        if (rank == 0) log_error("bench_dispatch needs at least 2 ranks");
+        MPI_Finalize();
+        return 1;
+    }
+
+    const char* mode = env_str("DISPATCH_MODE", "event");
+    int tasks = env_int("BENCH_TASKS", 200);
+    int work_us = env_int("BENCH_WORK_US", 0);
+    int workers = world_size - 1;
+
+    // Tasks go to whoever asks first, so a worker may do up to all of them
+    double* samples = malloc((size_t)tasks * workers * sizeof(double));
+    int n = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime(), cpu_start = cpu_seconds();
+
+    if (rank == 0) {
+        if (strcmp(mode, "poll") == 0)
+            dispatch_poll(world_size, tasks * workers);
+        else
+            dispatch_event(world_size, tasks * workers);
+    } else {
+        for (;;) {
+            int dummy = 0, task;
+            double t0 = MPI_Wtime();
+            MPI_Send(&dummy, 1, MPI_INT, 0, TAG_TASK_REQUEST, MPI_COMM_WORLD);
+            MPI_Recv(&task, 1, MPI_INT, 0, TAG_TASK_SEND, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (task < 0) break;
+            samples[n++] = MPI_Wtime() - t0;
+            for (double until = MPI_Wtime() + work_us * 1e-6; MPI_Wtime() < until;) {}
+        }
+    }
+    double elapsed = MPI_Wtime() - start, master_cpu = cpu_seconds() - cpu_start;
+
+    int* counts = rank == 0 ? malloc(world_size * sizeof(int)) : NULL;
+    int* offsets = rank == 0 ? malloc(world_size * sizeof(int)) : NULL;
+    MPI_Gather(&n, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    double* all = NULL;
+    int count = 0;
+    if (rank == 0) {
+        for (int i = 0; i < world_size; i++) {
+            offsets[i] = count;
+            count += counts[i];
+        }
+        all = malloc((count ? count : 1) * sizeof(double));
+    }
+    MPI_Gatherv(samples, n, MPI_DOUBLE, all, counts, offsets, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        double sum = 0.0;
+        for (int i = 0; i < count; i++) sum += all[i];
+        qsort(all, count, sizeof(double), compare_doubles);
+        log_info("bench_dispatch: %s mode, %d workers, %d round trips in %.3fs (master CPU %.3fs)",
+                 mode, workers, count, elapsed, master_cpu);
+        if (count > 0) {
+            log_info("bench_dispatch: request->task us: mean %.1f | p50 %.1f | p99 %.1f | max %.1f",
+                     1e6 * sum / count, 1e6 * all[count / 2], 1e6 * all[(int)(count * 0.99)], 1e6 * all[count - 1]);
+        }
+        free(all);
+        free(offsets);
+        free(counts);
+    }
+    free(samples);
+    MPI_Finalize();
+    return 0;
+}
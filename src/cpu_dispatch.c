@@ -0,0 +1,56 @@
+#include <pthread.h>
+#include <string.h>
+#include "cpu_kernels.h"
+#include "utils.h"
+
+// Kernel tables from best to worst; a level is usable when the CPU reports
+// every feature its translation unit was compiled for
+typedef struct {
+    const char* name;
+    const cpu_kernel_table* table;
+    int (*supported)(void);
+} isa_level;
+
+static int has_avx512(void) { return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"); }
+static int has_avx2(void) { return __builtin_cpu_supports("avx2"); }
+static int has_sse41(void) { return __builtin_cpu_supports("sse4.1"); }
+static int has_scalar(void) { return 1; }
+
+static const isa_level levels[] = {
+    { "avx512", &cpu_kernels_avx512, has_avx512 },
+    { "avx2",   &cpu_kernels_avx2,   has_avx2 },
+    { "sse41",  &cpu_kernels_sse41,  has_sse41 },
+    { "scalar", &cpu_kernels_scalar, has_scalar },
+};
+#define NUM_LEVELS (int)(sizeof(levels) / sizeof(levels[0]))
+
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static const cpu_kernel_table* selected;
+
+static void select_kernels(void) {
+    __builtin_cpu_init();
+
+    // Start from CPU_ISA if it names a level, otherwise from the best one
+    const char* requested = env_str("CPU_ISA", "");
+    int start = 0;
+    if (requested[0]) {
+        while (start < NUM_LEVELS && strcmp(levels[start].name, requested) != 0) start++;
+        if (start == NUM_LEVELS) {
+            log_error("CPU_ISA=%s is not one of avx512, avx2, sse41, scalar; ignoring it", requested);
+            start = 0;
+        }
+    }
+
+    int i = start;
+    while (!levels[i].supported()) i++;
+    if (i != start) {
+        log_error("CPU_ISA=%s is not supported by this CPU; using %s", levels[start].name, levels[i].name);
+    }
+    selected = levels[i].table;
+    log_info("CPU kernels: %s", selected->name);
+}
+
+const cpu_kernel_table* cpu_kernels(void) {
+    pthread_once(&select_once, select_kernels);
+    return selected;
+}
@@ -0,0 +1,719 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <omp.h>
+#include "cpu_filter.h"
+#include "cpu_kernels.h"
+#include "canny_common.h"
+#include "utils.h"
+
+// CPU mirror of the cuda_canny pipeline in cuda_filter.cu. Every stage keeps
+// the arithmetic of its kernel so both backends produce the same edge maps;
+// rows are split across OpenMP threads, and the row kernels are picked at
+// runtime for the host's instruction set (cpu_kernels.h).
+//
+// Stages are written as row kernels so they can run two ways:
+//   - full frame: each stage sweeps the whole image into a frame-sized buffer
+//   - streaming (CANNY_STREAMING=1): each thread pushes its band of rows
+//     through the whole chain, keeping only a small ring of rows per stage
+//
+// The gradient direction is either a float angle (as in sobel_kernel) or,
+// by default, a 1-byte sector from gradient_sector() (CANNY_DIRECTION=float
+// selects the angle path). Both give the same edges.
+//
+// Edge tracking is full hysteresis by default: one scan seeds a stack flood
+// from every strong pixel, so every weak pixel 8-connected to a strong one is
+// kept. CANNY_TRACKING=twopass restores the two fixed passes of cuda_canny.
+//
+// The double threshold is fixed (50 / 100) unless CANNY_THRESHOLDS selects an
+// automatic mode, which picks it per frame from the Sobel magnitude histogram.
+
+// Modes read from the environment on every call
+typedef struct {
+    int use_sector;       // CANNY_DIRECTION != float
+    int use_hysteresis;   // CANNY_TRACKING != twopass
+    int streaming;        // CANNY_STREAMING=1
+    int profile;          // CANNY_PROFILE=1
+    int threshold_mode;   // CANNY_THRESHOLDS (THRESH_* in canny_common.h)
+    int percentile;       // CANNY_PERCENTILE
+    unsigned char low_thresh, high_thresh;   // CANNY_LOW / CANNY_HIGH (fixed mode)
+} canny_options;
+
+// Flood-fill stack kept between frames; it only grows
+typedef struct {
+    size_t* items;
+    size_t capacity;
+} edge_stack;
+
+// Scratch memory owned by a cpu_canny_context. Buffers are sized for the
+// largest frame (and thread count) seen so far and only ever grow, so a
+// stream of same-sized frames allocates nothing after the first one.
+struct cpu_canny_context {
+    size_t pixels;            // frame buffers hold this many pixels
+    int width;                // per-thread row buffers hold rows this wide
+    int threads;              // per-thread slots
+    unsigned char *gray, *blur, *edge, *nms, *thresh, *final, *sector;
+    float* direction;         // allocated on first use (CANNY_DIRECTION=float)
+    unsigned short* blur_rings;     // 5 rows per thread
+    unsigned int* hist_subs;        // 4 x MAG_BINS per thread
+    unsigned char* stream_scratch;  // stream_bytes(width) per thread
+    edge_stack stack;
+};
+
+// Blurred row from five horizontal rows; border columns keep their gray value
+static void blur_row(const cpu_kernel_table* K, unsigned short* const hrows[5], const unsigned char* gray,
+                     unsigned char* dst, int width) {
+    K->blur_v_row(hrows, dst, width);
+    dst[0] = gray[0];
+    dst[1] = gray[1];
+    dst[width - 2] = gray[width - 2];
+    dst[width - 1] = gray[width - 1];
+}
+
+// Sobel gradient magnitude + angle in degrees for one interior row
+static void sobel_row(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                      unsigned char* mag, float* dir, int width) {
+    mag[0] = 0;
+    mag[width - 1] = 0;
+    for (int x = 1; x < width - 1; x++) {
+        int Gx = -up[x-1] + up[x+1] - 2 * mid[x-1] + 2 * mid[x+1] - down[x-1] + down[x+1];
+        int Gy = -up[x-1] - 2 * up[x] - up[x+1] + down[x-1] + 2 * down[x] + down[x+1];
+
+        int m = (int)sqrtf((float)(Gx * Gx + Gy * Gy));
+        mag[x] = m < 255 ? m : 255;
+        dir[x] = atan2f((float)Gy, (float)Gx) * 180.0f / M_PI;
+    }
+}
+
+// Non-maximum suppression for one interior row
+static void nms_row(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                    const float* dir, unsigned char* out, int width) {
+    out[0] = 0;
+    out[width - 1] = 0;
+    for (int x = 1; x < width - 1; x++) {
+        float angle = fmodf(dir[x] + 180.0f, 180.0f);  // Normalize to [0,180)
+        float mag = mid[x];
+        float m1 = 0, m2 = 0;
+
+        if ((angle >= 0 && angle < 22.5) || (angle >= 157.5 && angle < 180)) {
+            m1 = mid[x + 1];
+            m2 = mid[x - 1];
+        } else if (angle >= 22.5 && angle < 67.5) {
+            m1 = up[x + 1];
+            m2 = down[x - 1];
+        } else if (angle >= 67.5 && angle < 112.5) {
+            m1 = up[x];
+            m2 = down[x];
+        } else if (angle >= 112.5 && angle < 157.5) {
+            m1 = up[x - 1];
+            m2 = down[x + 1];
+        }
+
+        out[x] = (mag >= m1 && mag >= m2) ? (unsigned char)mag : 0;
+    }
+}
+
+// One propagation pass over an interior row: weak pixels touching a strong
+// pixel become strong
+static void tracking_row(const unsigned char* up, const unsigned char* mid, const unsigned char* down,
+                         unsigned char* out, int width) {
+    out[0] = mid[0];
+    out[width - 1] = mid[width - 1];
+    #pragma omp simd
+    for (int x = 1; x < width - 1; x++) {
+        unsigned char v = mid[x];
+        int strong_near = up[x-1] == STRONG_EDGE || up[x] == STRONG_EDGE || up[x+1] == STRONG_EDGE
+                       || mid[x-1] == STRONG_EDGE || mid[x+1] == STRONG_EDGE
+                       || down[x-1] == STRONG_EDGE || down[x] == STRONG_EDGE || down[x+1] == STRONG_EDGE;
+        out[x] = (v == STRONG_EDGE || (v == WEAK_EDGE && strong_near)) ? STRONG_EDGE : 0;
+    }
+}
+
+// Hysteresis in place: weak pixels connected to a strong pixel become strong,
+// the rest are cleared. The seed scan visits each pixel once and every weak
+// pixel is pushed at most once, so the cost is linear in the frame size.
+static void hysteresis(unsigned char* edges, int width, int height, edge_stack* st) {
+    if (width < 3 || height < 3) {
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            if (edges[i] == WEAK_EDGE) edges[i] = 0;
+        }
+        return;
+    }
+
+    size_t capacity = st->capacity;
+    size_t top = 0;
+    size_t* stack = st->items;
+    const long offsets[8] = { -(long)width - 1, -(long)width, -(long)width + 1, -1, 1,
+                              (long)width - 1, (long)width, (long)width + 1 };
+
+    for (int y = 1; y < height - 1; y++) {
+        for (int x = 1; x < width - 1; x++) {
+            size_t seed = (size_t)y * width + x;
+            if (edges[seed] != STRONG_EDGE) continue;
+
+            stack[top++] = seed;
+            while (top > 0) {
+                size_t p = stack[--top];
+                for (int k = 0; k < 8; k++) {
+                    size_t q = p + offsets[k];
+                    if (edges[q] != WEAK_EDGE) continue;
+                    // Border pixels are never weak (NMS leaves them 0), but
+                    // keep the flood inside the frame regardless
+                    int qy = (int)(q / width), qx = (int)(q % width);
+                    edges[q] = STRONG_EDGE;
+                    if (qx == 0 || qy == 0 || qx == width - 1 || qy == height - 1) continue;
+                    if (top == capacity) {
+                        capacity *= 2;
+                        stack = realloc(stack, capacity * sizeof(size_t));
+                    }
+                    stack[top++] = q;
+                }
+            }
+        }
+    }
+    st->items = stack;
+    st->capacity = capacity;
+
+    size_t img_size = (size_t)width * height;
+    #pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < img_size; i++) {
+        if (edges[i] == WEAK_EDGE) edges[i] = 0;
+    }
+}
+
+// -------------------- Full-frame stages --------------------
+
+// Convert RGB image to grayscale
+static void rgb_to_gray(const unsigned char* input, unsigned char* gray, int width, int height, int channels) {
+    const cpu_kernel_table* K = cpu_kernels();
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        K->gray_row(input + (size_t)y * width * channels, gray + (size_t)y * width, width, channels);
+    }
+}
+
+// Apply 5x5 Gaussian blur as two separable passes (border pixels keep their
+// gray value). Each thread walks its own band of rows with a ring of five
+// horizontally blurred rows (its slot of rings: 5 * width per thread).
+static void gaussian_blur_5x5(const unsigned char* gray, unsigned char* blurred, int width, int height,
+                              unsigned short* rings) {
+    if (width < 5 || height < 5) {
+        memcpy(blurred, gray, (size_t)width * height);
+        return;
+    }
+    const cpu_kernel_table* K = cpu_kernels();
+    memcpy(blurred, gray, (size_t)2 * width);
+    memcpy(blurred + (size_t)(height - 2) * width, gray + (size_t)(height - 2) * width, (size_t)2 * width);
+
+    #pragma omp parallel
+    {
+        int nthreads = omp_get_num_threads();
+        int t = omp_get_thread_num();
+        int y0 = 2 + (height - 4) * t / nthreads;
+        int y1 = 2 + (height - 4) * (t + 1) / nthreads;
+        unsigned short* ring = rings + (size_t)t * 5 * width;
+        unsigned short* rows[5];
+
+        for (int y = y0 - 2; y < y0 + 2 && y0 < y1; y++) {
+            K->blur_h_row(gray + (size_t)y * width, ring + (size_t)(y % 5) * width, width);
+        }
+        for (int y = y0; y < y1; y++) {
+            K->blur_h_row(gray + (size_t)(y + 2) * width, ring + (size_t)((y + 2) % 5) * width, width);
+            for (int k = 0; k < 5; k++) rows[k] = ring + (size_t)((y - 2 + k) % 5) * width;
+            blur_row(K, rows, gray + (size_t)y * width, blurred + (size_t)y * width, width);
+        }
+    }
+}
+
+// Count the interior magnitudes of one row. Four sub-histograms keep runs of
+// equal values (flat areas) from serializing on a single counter.
+static void histogram_row(const unsigned char* mag, unsigned int sub[4][MAG_BINS], int width) {
+    int x = 1;
+    for (; x + 4 <= width - 1; x += 4) {
+        sub[0][mag[x]]++;
+        sub[1][mag[x + 1]]++;
+        sub[2][mag[x + 2]]++;
+        sub[3][mag[x + 3]]++;
+    }
+    for (; x < width - 1; x++) sub[0][mag[x]]++;
+}
+
+// Apply Sobel filter (border pixels are set to 0). Exactly one of direction
+// (float angle) and sector (byte code) is non-NULL. If hist is non-NULL it
+// receives the magnitude histogram of the interior pixels: each thread counts
+// the rows it just produced (still in cache) into its own slot of hist_subs
+// (4 x MAG_BINS per thread), and the copies are merged once at the end.
+static void sobel(const unsigned char* blurred, unsigned char* edge, float* direction, unsigned char* sector,
+                  unsigned int* hist, unsigned int* hist_subs, int width, int height) {
+    const cpu_kernel_table* K = cpu_kernels();
+    memset(edge, 0, width);
+    memset(edge + (size_t)(height - 1) * width, 0, width);
+    if (hist) memset(hist, 0, MAG_BINS * sizeof(unsigned int));
+
+    #pragma omp parallel
+    {
+        unsigned int (*sub)[MAG_BINS] = NULL;
+        if (hist) {
+            sub = (unsigned int (*)[MAG_BINS])(hist_subs + (size_t)omp_get_thread_num() * 4 * MAG_BINS);
+            memset(sub, 0, 4 * sizeof(*sub));
+        }
+
+        #pragma omp for schedule(static)
+        for (int y = 1; y < height - 1; y++) {
+            size_t i = (size_t)y * width;
+            if (sector)
+                K->sobel_sector_row(blurred + i - width, blurred + i, blurred + i + width, edge + i, sector + i, width);
+            else
+                sobel_row(blurred + i - width, blurred + i, blurred + i + width, edge + i, direction + i, width);
+            if (sub) histogram_row(edge + i, sub, width);
+        }
+
+        if (sub) {
+            #pragma omp critical
+            for (int m = 0; m < MAG_BINS; m++) hist[m] += sub[0][m] + sub[1][m] + sub[2][m] + sub[3][m];
+        }
+    }
+}
+
+// Apply non-maximum suppression (border pixels are set to 0)
+static void non_max_suppression(const unsigned char* gradient, const float* direction, const unsigned char* sector,
+                                unsigned char* output, int width, int height) {
+    const cpu_kernel_table* K = cpu_kernels();
+    memset(output, 0, width);
+    memset(output + (size_t)(height - 1) * width, 0, width);
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < height - 1; y++) {
+        size_t i = (size_t)y * width;
+        if (sector)
+            K->nms_sector_row(gradient + i - width, gradient + i, gradient + i + width, sector + i, output + i, width);
+        else
+            nms_row(gradient + i - width, gradient + i, gradient + i + width, direction + i, output + i, width);
+    }
+}
+
+// Apply double thresholding
+static void double_threshold(const unsigned char* input, unsigned char* output, int width, int height,
+                             unsigned char low_thresh, unsigned char high_thresh) {
+    const cpu_kernel_table* K = cpu_kernels();
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        size_t i = (size_t)y * width;
+        K->threshold_row(input + i, output + i, width, low_thresh, high_thresh);
+    }
+}
+
+// One propagation pass over the frame (border pixels are copied)
+static void edge_tracking_pass(const unsigned char* input, unsigned char* output, int width, int height) {
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        size_t i = (size_t)y * width;
+        if (y == 0 || y == height - 1 || width < 3) {
+            memcpy(output + i, input + i, width);
+            continue;
+        }
+        tracking_row(input + i - width, input + i, input + i + width, output + i, width);
+    }
+}
+
+static void canny_full_frame(cpu_canny_context* ctx, unsigned char* input, unsigned char* output,
+                             int width, int height, int channels, const canny_options* opt) {
+    // 1-channel input (e.g. the Y plane of a Y4M frame) is already gray
+    const unsigned char* gray = channels == 1 ? input : ctx->gray;
+    unsigned char* blur = ctx->blur;
+    unsigned char* edge = ctx->edge;
+    unsigned char* nms = ctx->nms;
+    unsigned char* thresh = ctx->thresh;
+    unsigned char* final = ctx->final;
+    float* direction = opt->use_sector ? NULL : ctx->direction;
+    unsigned char* sector = opt->use_sector ? ctx->sector : NULL;
+
+    unsigned int hist[MAG_BINS];
+    int auto_thresh = opt->threshold_mode != THRESH_FIXED;
+    unsigned char low_thresh = opt->low_thresh, high_thresh = opt->high_thresh;
+
+    // CANNY_PROFILE=1 logs the time spent in each stage
+    double t[7];
+    t[0] = omp_get_wtime();
+    if (channels != 1) rgb_to_gray(input, ctx->gray, width, height, channels);
+    t[1] = omp_get_wtime();
+    gaussian_blur_5x5(gray, blur, width, height, ctx->blur_rings);
+    t[2] = omp_get_wtime();
+    sobel(blur, edge, direction, sector, auto_thresh ? hist : NULL, ctx->hist_subs, width, height);
+    if (auto_thresh) thresholds_from_histogram(hist, opt->threshold_mode, opt->percentile, &low_thresh, &high_thresh);
+    t[3] = omp_get_wtime();
+    non_max_suppression(edge, direction, sector, nms, width, height);
+    t[4] = omp_get_wtime();
+
+    double_threshold(nms, opt->use_hysteresis ? output : thresh, width, height, low_thresh, high_thresh);
+    t[5] = omp_get_wtime();
+
+    if (opt->use_hysteresis) {
+        hysteresis(output, width, height, &ctx->stack);
+    } else {
+        // Run edge tracking 2 iterations
+        edge_tracking_pass(thresh, final, width, height);
+        edge_tracking_pass(final, output, width, height);
+    }
+    t[6] = omp_get_wtime();
+
+    if (opt->profile) {
+        log_info("CPU CANNY %dx%d: gray %.2f | blur %.2f | sobel %.2f | nms %.2f | thresh %.2f | track %.2f | total %.2f ms"
+                 " (thresholds %d/%d)",
+                 width, height, (t[1] - t[0]) * 1e3, (t[2] - t[1]) * 1e3, (t[3] - t[2]) * 1e3,
+                 (t[4] - t[3]) * 1e3, (t[5] - t[4]) * 1e3, (t[6] - t[5]) * 1e3, (t[6] - t[0]) * 1e3,
+                 low_thresh, high_thresh);
+    }
+}
+
+// -------------------- Streaming stages --------------------
+
+// Ring sizes: rows each consumer reads at once (blur needs y-2..y+2, the
+// 3x3 stages need y-1..y+1). The direction ring stays in step with the mag ring.
+#define GRAY_RING  5
+#define SMALL_RING 3
+
+// Per-thread line buffers; every stage remembers the next row it will produce
+// and pulls rows from the stage before it one at a time, so a ring is never
+// asked to hold more rows than its size
+typedef struct {
+    const cpu_kernel_table* kernels;
+    const unsigned char* input;
+    int width, height, channels;
+    unsigned char low_thresh, high_thresh;
+    unsigned char* gray;     // GRAY_RING rows
+    unsigned short* hblur;   // GRAY_RING horizontally blurred rows
+    unsigned char* blur;     // SMALL_RING rows
+    unsigned char* mag;      // SMALL_RING rows
+    float* dir;              // SMALL_RING rows (float angle mode)
+    unsigned char* sector;   // SMALL_RING rows (sector mode)
+    unsigned char* thresh;   // SMALL_RING rows (NMS + double threshold)
+    unsigned char* track;    // SMALL_RING rows (first tracking pass)
+    int next_gray, next_blur, next_sobel, next_thresh, next_track;
+} canny_stream;
+
+#define RING_ROW(buf, ring, y, width) ((buf) + (size_t)((y) % (ring)) * (width))
+
+static void stream_gray_upto(canny_stream* s, int y_last) {
+    int w = s->width;
+    if (y_last > s->height - 1) y_last = s->height - 1;
+    for (; s->next_gray <= y_last; s->next_gray++) {
+        int y = s->next_gray;
+        unsigned char* g = RING_ROW(s->gray, GRAY_RING, y, w);
+        s->kernels->gray_row(s->input + (size_t)y * w * s->channels, g, w, s->channels);
+        if (w >= 5) s->kernels->blur_h_row(g, RING_ROW(s->hblur, GRAY_RING, y, w), w);
+    }
+}
+
+static void stream_blur_upto(canny_stream* s, int y_last) {
+    int w = s->width, h = s->height;
+    if (y_last > h - 1) y_last = h - 1;
+    for (; s->next_blur <= y_last; s->next_blur++) {
+        int y = s->next_blur;
+        stream_gray_upto(s, y + 2);
+        const unsigned char* g = RING_ROW(s->gray, GRAY_RING, y, w);
+        unsigned char* dst = RING_ROW(s->blur, SMALL_RING, y, w);
+        if (y < 2 || y >= h - 2 || w < 5) {
+            memcpy(dst, g, w);
+            continue;
+        }
+        unsigned short* rows[5];
+        for (int k = 0; k < 5; k++) rows[k] = RING_ROW(s->hblur, GRAY_RING, y - 2 + k, w);
+        blur_row(s->kernels, rows, g, dst, w);
+    }
+}
+
+static void stream_sobel_upto(canny_stream* s, int y_last) {
+    int w = s->width, h = s->height;
+    if (y_last > h - 1) y_last = h - 1;
+    for (; s->next_sobel <= y_last; s->next_sobel++) {
+        int y = s->next_sobel;
+        stream_blur_upto(s, y + 1);
+        unsigned char* mag = RING_ROW(s->mag, SMALL_RING, y, w);
+        if (y == 0 || y == h - 1) {
+            memset(mag, 0, w);
+            continue;
+        }
+        const unsigned char* up = RING_ROW(s->blur, SMALL_RING, y - 1, w);
+        const unsigned char* mid = RING_ROW(s->blur, SMALL_RING, y, w);
+        const unsigned char* down = RING_ROW(s->blur, SMALL_RING, y + 1, w);
+        if (s->sector)
+            s->kernels->sobel_sector_row(up, mid, down, mag, RING_ROW(s->sector, SMALL_RING, y, w), w);
+        else
+            sobel_row(up, mid, down, mag, RING_ROW(s->dir, SMALL_RING, y, w), w);
+    }
+}
+
+static void stream_thresh_upto(canny_stream* s, int y_last) {
+    int w = s->width, h = s->height;
+    if (y_last > h - 1) y_last = h - 1;
+    for (; s->next_thresh <= y_last; s->next_thresh++) {
+        int y = s->next_thresh;
+        stream_sobel_upto(s, y + 1);
+        unsigned char* out = RING_ROW(s->thresh, SMALL_RING, y, w);
+        if (y == 0 || y == h - 1) {
+            memset(out, 0, w);
+        } else {
+            const unsigned char* up = RING_ROW(s->mag, SMALL_RING, y - 1, w);
+            const unsigned char* mid = RING_ROW(s->mag, SMALL_RING, y, w);
+            const unsigned char* down = RING_ROW(s->mag, SMALL_RING, y + 1, w);
+            if (s->sector)
+                s->kernels->nms_sector_row(up, mid, down, RING_ROW(s->sector, SMALL_RING, y, w), out, w);
+            else
+                nms_row(up, mid, down, RING_ROW(s->dir, SMALL_RING, y, w), out, w);
+        }
+        // Apply double thresholding with the stream's low/high, taken from
+        // the context's options (CANNY_LOW / CANNY_HIGH)
+        s->kernels->threshold_row(out, out, w, s->low_thresh, s->high_thresh);
+    }
+}
+
+static void stream_track_upto(canny_stream* s, int y_last) {
+    int w = s->width, h = s->height;
+    if (y_last > h - 1) y_last = h - 1;
+    for (; s->next_track <= y_last; s->next_track++) {
+        int y = s->next_track;
+        stream_thresh_upto(s, y + 1);
+        const unsigned char* mid = RING_ROW(s->thresh, SMALL_RING, y, w);
+        unsigned char* out = RING_ROW(s->track, SMALL_RING, y, w);
+        if (y == 0 || y == h - 1 || w < 3) {
+            memcpy(out, mid, w);
+            continue;
+        }
+        tracking_row(RING_ROW(s->thresh, SMALL_RING, y - 1, w), mid, RING_ROW(s->thresh, SMALL_RING, y + 1, w), out, w);
+    }
+}
+
+// Push rows y0..y1-1 of the output through the whole chain. Each stage starts
+// far enough above y0 to cover the halo of the stages after it. With
+// hysteresis the band stops at the thresholded rows, written to the output.
+static void canny_stream_band(canny_stream* s, unsigned char* output, int y0, int y1, int use_hysteresis) {
+    int w = s->width, h = s->height;
+    s->next_track = y0 > 1 ? y0 - 1 : 0;
+    s->next_thresh = y0 > 2 ? y0 - 2 : 0;
+    s->next_sobel = y0 > 3 ? y0 - 3 : 0;
+    s->next_blur = y0 > 4 ? y0 - 4 : 0;
+    s->next_gray = y0 > 6 ? y0 - 6 : 0;
+
+    if (use_hysteresis) {
+        for (int y = y0; y < y1; y++) {
+            stream_thresh_upto(s, y);
+            memcpy(output + (size_t)y * w, RING_ROW(s->thresh, SMALL_RING, y, w), w);
+        }
+        return;
+    }
+
+    for (int y = y0; y < y1; y++) {
+        stream_track_upto(s, y + 1);
+        const unsigned char* mid = RING_ROW(s->track, SMALL_RING, y, w);
+        unsigned char* out = output + (size_t)y * w;
+        // Second tracking pass writes straight into the output frame
+        if (y == 0 || y == h - 1 || w < 3) {
+            memcpy(out, mid, w);
+            continue;
+        }
+        tracking_row(RING_ROW(s->track, SMALL_RING, y - 1, w), mid, RING_ROW(s->track, SMALL_RING, y + 1, w), out, w);
+    }
+}
+
+// Per-thread streaming scratch: about 30 bytes per pixel of width with
+// sectors, 39 with float angles (sized for the latter)
+static size_t stream_bytes(int width) {
+    size_t w = width;
+    return GRAY_RING * w * sizeof(unsigned short) + SMALL_RING * w * sizeof(float) + GRAY_RING * w + 4 * SMALL_RING * w;
+}
+
+static void canny_streaming(cpu_canny_context* ctx, unsigned char* input, unsigned char* output,
+                            int width, int height, int channels, const canny_options* opt) {
+    int use_sector = opt->use_sector;
+    const cpu_kernel_table* kernels = cpu_kernels();
+    double t0 = omp_get_wtime();
+
+    #pragma omp parallel
+    {
+        int nthreads = omp_get_num_threads();
+        int t = omp_get_thread_num();
+        canny_stream s = {0};
+        s.kernels = kernels;
+        s.input = input;
+        s.width = width;
+        s.height = height;
+        s.channels = channels;
+        s.low_thresh = opt->low_thresh;
+        s.high_thresh = opt->high_thresh;
+
+        size_t w = width;
+        size_t dir_bytes = SMALL_RING * w * (use_sector ? 1 : sizeof(float));
+        unsigned char* scratch = ctx->stream_scratch + (size_t)t * stream_bytes(width);
+        s.hblur = (unsigned short*)scratch;
+        if (use_sector)
+            s.sector = scratch + GRAY_RING * w * sizeof(unsigned short);
+        else
+            s.dir = (float*)(scratch + GRAY_RING * w * sizeof(unsigned short));
+        s.gray = scratch + GRAY_RING * w * sizeof(unsigned short) + dir_bytes;
+        s.blur = s.gray + GRAY_RING * w;
+        s.mag = s.blur + SMALL_RING * w;
+        s.thresh = s.mag + SMALL_RING * w;
+        s.track = s.thresh + SMALL_RING * w;
+
+        canny_stream_band(&s, output, height * t / nthreads, height * (t + 1) / nthreads, opt->use_hysteresis);
+    }
+
+    // The flood needs the whole frame; it runs in place on the output and its
+    // stack holds at most the weak pixels
+    double t1 = omp_get_wtime();
+    if (opt->use_hysteresis) hysteresis(output, width, height, &ctx->stack);
+    double t2 = omp_get_wtime();
+
+    if (opt->profile) {
+        log_info("CPU CANNY %dx%d: streaming %.2f | track %.2f | total %.2f ms",
+                 width, height, (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t2 - t0) * 1e3);
+    }
+}
+
+int cpu_filter_init_threads(int ranks_per_node) {
+    int threads = 0;
+    if (ranks_per_node > 0) {
+        // Never more than the cores this rank is bound to
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN) / ranks_per_node;
+        if (threads > omp_get_num_procs()) threads = omp_get_num_procs();
+        if (threads < 1) threads = 1;
+    }
+    threads = env_int("FILTER_THREADS", threads);
+    if (threads > 0) omp_set_num_threads(threads);
+    return omp_get_max_threads();
+}
+
+// Row bands are split across threads; border pixels are set to 0
+void simple_edge_filter(unsigned char* input, unsigned char* output, int w, int h, int c) {
+    if (h < 3) {
+        memset(output, 0, (size_t)w * h);
+        return;
+    }
+    memset(output, 0, w);
+    memset(output + (size_t)(h - 1) * w, 0, w);
+
+    const cpu_kernel_table* K = cpu_kernels();
+    size_t stride = (size_t)w * c;
+    #pragma omp parallel for schedule(static)
+    for (int y = 1; y < h - 1; y++) {
+        const unsigned char* mid = input + (size_t)y * stride;
+        K->simple_edge_row(mid - stride, mid, mid + stride, output + (size_t)y * w, w, c);
+    }
+}
+
+// -------------------- Context --------------------
+
+static void free_frame_buffers(cpu_canny_context* ctx) {
+    free(ctx->gray);
+    free(ctx->blur);
+    free(ctx->edge);
+    free(ctx->nms);
+    free(ctx->thresh);
+    free(ctx->final);
+    free(ctx->sector);
+    free(ctx->direction);
+    ctx->direction = NULL;
+}
+
+// Make the scratch buffers large enough for a width x height frame on the
+// current OpenMP thread count; existing buffers are kept when they fit. The
+// frame-sized buffers are only needed by the full-frame path (need_frames):
+// streaming works in its per-thread line rings, so its scratch stays O(width)
+// apart from the hysteresis stack.
+static void context_reserve(cpu_canny_context* ctx, int width, int height, int need_frames, int need_direction) {
+    size_t pixels = (size_t)width * height;
+    int threads = omp_get_max_threads();
+
+    if (need_frames && pixels > ctx->pixels) {
+        free_frame_buffers(ctx);
+        ctx->gray = malloc(pixels);
+        ctx->blur = malloc(pixels);
+        ctx->edge = malloc(pixels);
+        ctx->nms = malloc(pixels);
+        ctx->thresh = malloc(pixels);
+        ctx->final = malloc(pixels);
+        ctx->sector = malloc(pixels);
+        ctx->pixels = pixels;
+    }
+    if (need_frames && need_direction && !ctx->direction) ctx->direction = malloc(ctx->pixels * sizeof(float));
+
+    if (width > ctx->width || threads > ctx->threads) {
+        if (width < ctx->width) width = ctx->width;
+        if (threads < ctx->threads) threads = ctx->threads;
+        free(ctx->blur_rings);
+        free(ctx->hist_subs);
+        free(ctx->stream_scratch);
+        ctx->blur_rings = malloc((size_t)threads * 5 * width * sizeof(unsigned short));
+        ctx->hist_subs = malloc((size_t)threads * 4 * MAG_BINS * sizeof(unsigned int));
+        ctx->stream_scratch = malloc((size_t)threads * stream_bytes(width));
+        ctx->width = width;
+        ctx->threads = threads;
+    }
+
+    if (ctx->stack.capacity == 0) {
+        ctx->stack.capacity = (size_t)width * 4;
+        ctx->stack.items = malloc(ctx->stack.capacity * sizeof(size_t));
+    }
+}
+
+// Streaming thresholds rows before the frame's histogram is complete, so
+// the automatic modes always use the full-frame path
+static int use_streaming(const canny_options* opt) {
+    return opt->streaming && opt->threshold_mode == THRESH_FIXED;
+}
+
+static void read_options(canny_options* opt) {
+    opt->use_sector = strcmp(env_str("CANNY_DIRECTION", "sector"), "float") != 0;
+    opt->use_hysteresis = strcmp(env_str("CANNY_TRACKING", "hysteresis"), "twopass") != 0;
+    opt->streaming = env_int("CANNY_STREAMING", 0);
+    opt->profile = env_int("CANNY_PROFILE", 0);
+    opt->threshold_mode = threshold_mode_from_name(env_str("CANNY_THRESHOLDS", "fixed"));
+    opt->percentile = env_int("CANNY_PERCENTILE", 70);
+    opt->low_thresh = env_int("CANNY_LOW", DEFAULT_LOW_THRESH);
+    opt->high_thresh = env_int("CANNY_HIGH", DEFAULT_HIGH_THRESH);
+}
+
+cpu_canny_context* cpu_canny_create(int max_width, int max_height) {
+    cpu_canny_context* ctx = calloc(1, sizeof(cpu_canny_context));
+    if (max_width > 0 && max_height > 0) {
+        canny_options opt;
+        read_options(&opt);
+        context_reserve(ctx, max_width, max_height, !use_streaming(&opt), !opt.use_sector);
+    }
+    return ctx;
+}
+
+void cpu_canny_destroy(cpu_canny_context* ctx) {
+    if (!ctx) return;
+    free_frame_buffers(ctx);
+    free(ctx->blur_rings);
+    free(ctx->hist_subs);
+    free(ctx->stream_scratch);
+    free(ctx->stack.items);
+    free(ctx);
+}
+
+void cpu_canny_run(cpu_canny_context* ctx, unsigned char* input, unsigned char* output,
+                   int width, int height, int channels, unsigned char* prev_edge) {
+    // prev_edge is accepted for parity with cuda_canny; like the CUDA path the
+    // temporal link does not feed the returned edge map.
+    (void)prev_edge;
+
+    canny_options opt;
+    read_options(&opt);
+
+    int streaming = use_streaming(&opt);
+    context_reserve(ctx, width, height, !streaming, !opt.use_sector);
+    if (streaming) {
+        canny_streaming(ctx, input, output, width, height, channels, &opt);
+    } else {
+        canny_full_frame(ctx, input, output, width, height, channels, &opt);
+    }
+}
+
+void cpu_canny(unsigned char* input, unsigned char* output, int width, int height, int channels, unsigned char* prev_edge) {
+    cpu_canny_context* ctx = cpu_canny_create(0, 0);
+    cpu_canny_run(ctx, input, output, width, height, channels, prev_edge);
+    cpu_canny_destroy(ctx);
+}
@@ -0,0 +1,3 @@
+// CPU row kernels: AVX2
+#define CPU_KERNEL_ISA avx2
+#include "cpu_kernels_impl.h"
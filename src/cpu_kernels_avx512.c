@@ -0,0 +1,3 @@
+// CPU row kernels: AVX-512 (F + BW)
+#define CPU_KERNEL_ISA avx512
+#include "cpu_kernels_impl.h"
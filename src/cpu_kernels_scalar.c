@@ -0,0 +1,4 @@
+// CPU row kernels: plain C, no vectorization (reference and fallback)
+#define CPU_KERNELS_SCALAR
+#define CPU_KERNEL_ISA scalar
+#include "cpu_kernels_impl.h"
@@ -0,0 +1,3 @@
+// CPU row kernels: SSE4.1
+#define CPU_KERNEL_ISA sse41
+#include "cpu_kernels_impl.h"
@@ -1,13 +1,50 @@
 #include <cuda_runtime.h>
 #include <math.h>
+#include <string.h>
 #include "cuda_filter.h"
+#include "canny_common.h"
+#include "utils.h"
 
 // Convert RGB image to grayscale
-__global__ void rgb_to_gray_kernel(unsigned char* input, unsigned char* gray, int width, int height, int channels) {
+// Fixed-point conversion specialized on the channel count (same result as the
+// CPU gray_row). CHANNELS == 0 handles any other layout at runtime.
+template <int CHANNELS>
+__global__ void rgb_to_gray_kernel(const unsigned char* input, unsigned char* gray, int width, int height, int channels) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
     if (idx >= width * height) return;
-    int i = idx * channels;
-    gray[idx] = 0.299f * input[i] + 0.587f * input[i+1] + 0.114f * input[i+2];
+
+    if (CHANNELS == 4) {
+        uchar4 px = reinterpret_cast<const uchar4*>(input)[idx];
+        gray[idx] = gray_from_rgb(px.x, px.y, px.z);
+    } else if (CHANNELS == 3) {
+        const unsigned char* p = input + (size_t)idx * 3;
+        gray[idx] = gray_from_rgb(p[0], p[1], p[2]);
+    } else if (CHANNELS == 1) {
+        gray[idx] = input[idx];
+    } else {
+        const unsigned char* p = input + (size_t)idx * channels;
+        gray[idx] = channels < 3 ? p[0] : gray_from_rgb(p[0], p[1], p[2]);
+    }
+}
+
+static void launch_rgb_to_gray(const unsigned char* d_input, unsigned char* d_gray, int width, int height, int channels) {
+    int img_size = width * height;
+    int threads = 256;
+    int blocks = (img_size + threads - 1) / threads;
+    switch (channels) {
+    case 1:
+        cudaMemcpy(d_gray, d_input, img_size, cudaMemcpyDeviceToDevice);
+        break;
+    case 3:
+        rgb_to_gray_kernel<3><<<blocks, threads>>>(d_input, d_gray, width, height, channels);
+        break;
+    case 4:
+        rgb_to_gray_kernel<4><<<blocks, threads>>>(d_input, d_gray, width, height, channels);
+        break;
+    default:
+        rgb_to_gray_kernel<0><<<blocks, threads>>>(d_input, d_gray, width, height, channels);
+        break;
+    }
 }
 
 // Apply Gaussian Blur
@@ -57,25 +94,77 @@ __global__ void gaussian_blur_kernel_5x5(unsigned char* gray, unsigned char* blu
     blurred[i] = sum / weight_sum;
 }
 
-// Apply Sobel filter
-__global__ void sobel_kernel(unsigned char* blurred, unsigned char* edge, float* direction, int width, int height) {
+// Optional magnitude histogram for the automatic thresholds: each block
+// counts into shared memory and adds its non-zero bins to the global
+// histogram once, so global atomics stay at most MAG_BINS per block.
+__device__ void block_histogram_init(unsigned int* block_hist, const unsigned int* hist) {
+    if (!hist) return;
+    int tid = threadIdx.y * blockDim.x + threadIdx.x;
+    for (int b = tid; b < MAG_BINS; b += blockDim.x * blockDim.y) block_hist[b] = 0;
+    __syncthreads();
+}
+
+__device__ void block_histogram_flush(const unsigned int* block_hist, unsigned int* hist) {
+    if (!hist) return;
+    __syncthreads();
+    int tid = threadIdx.y * blockDim.x + threadIdx.x;
+    for (int b = tid; b < MAG_BINS; b += blockDim.x * blockDim.y) {
+        if (block_hist[b]) atomicAdd(&hist[b], block_hist[b]);
+    }
+}
+
+// Apply Sobel filter (hist may be NULL)
+__global__ void sobel_kernel(unsigned char* blurred, unsigned char* edge, float* direction, int width, int height,
+                             unsigned int* hist) {
+    __shared__ unsigned int block_hist[MAG_BINS];
     int x = blockIdx.x * blockDim.x + threadIdx.x;
     int y = blockIdx.y * blockDim.y + threadIdx.y;
-    if (x < 1 || y < 1 || x >= width - 1 || y >= height - 1) return;
+    block_histogram_init(block_hist, hist);
 
-    int i = y * width + x;
-    int Gx = -1 * blurred[(y-1)*width + (x-1)] + 1 * blurred[(y-1)*width + (x+1)]
-           -2 * blurred[y*width + (x-1)] + 2 * blurred[y*width + (x+1)]
-           -1 * blurred[(y+1)*width + (x-1)] + 1 * blurred[(y+1)*width + (x+1)];
+    if (x >= 1 && y >= 1 && x < width - 1 && y < height - 1) {
+        int i = y * width + x;
+        int Gx = -1 * blurred[(y-1)*width + (x-1)] + 1 * blurred[(y-1)*width + (x+1)]
+               -2 * blurred[y*width + (x-1)] + 2 * blurred[y*width + (x+1)]
+               -1 * blurred[(y+1)*width + (x-1)] + 1 * blurred[(y+1)*width + (x+1)];
+
+        int Gy = -1 * blurred[(y-1)*width + (x-1)] - 2 * blurred[(y-1)*width + x] - 1 * blurred[(y-1)*width + (x+1)]
+               +1 * blurred[(y+1)*width + (x-1)] + 2 * blurred[(y+1)*width + x] + 1 * blurred[(y+1)*width + (x+1)];
+
+        int mag = min(255, (int)sqrtf((float)(Gx * Gx + Gy * Gy)));
+        edge[i] = mag;
+        if (hist) atomicAdd(&block_hist[mag], 1u);
+
+        float angle = atan2f((float)Gy, (float)Gx) * 180.0f / M_PI;
+        direction[i] = angle;
+    }
+
+    block_histogram_flush(block_hist, hist);
+}
 
-    int Gy = -1 * blurred[(y-1)*width + (x-1)] - 2 * blurred[(y-1)*width + x] - 1 * blurred[(y-1)*width + (x+1)]
-           +1 * blurred[(y+1)*width + (x-1)] + 2 * blurred[(y+1)*width + x] + 1 * blurred[(y+1)*width + (x+1)];
+// Apply Sobel filter, storing a 1-byte direction sector instead of a float angle
+__global__ void sobel_sector_kernel(unsigned char* blurred, unsigned char* edge, unsigned char* sector, int width, int height,
+                                    unsigned int* hist) {
+    __shared__ unsigned int block_hist[MAG_BINS];
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    block_histogram_init(block_hist, hist);
+
+    if (x >= 1 && y >= 1 && x < width - 1 && y < height - 1) {
+        int i = y * width + x;
+        int Gx = -1 * blurred[(y-1)*width + (x-1)] + 1 * blurred[(y-1)*width + (x+1)]
+               -2 * blurred[y*width + (x-1)] + 2 * blurred[y*width + (x+1)]
+               -1 * blurred[(y+1)*width + (x-1)] + 1 * blurred[(y+1)*width + (x+1)];
 
-    edge[i] = min(255, (int)sqrtf((float)(Gx * Gx + Gy * Gy)));
+        int Gy = -1 * blurred[(y-1)*width + (x-1)] - 2 * blurred[(y-1)*width + x] - 1 * blurred[(y-1)*width + (x+1)]
+               +1 * blurred[(y+1)*width + (x-1)] + 2 * blurred[(y+1)*width + x] + 1 * blurred[(y+1)*width + (x+1)];
 
-    float angle = atan2f((float)Gy, (float)Gx) * 180.0f / M_PI;
-    direction[i] = angle;
+        int mag = min(255, (int)sqrtf((float)(Gx * Gx + Gy * Gy)));
+        edge[i] = mag;
+        if (hist) atomicAdd(&block_hist[mag], 1u);
+        sector[i] = gradient_sector(Gx, Gy);
+    }
 
+    block_histogram_flush(block_hist, hist);
 }
 
 // Apply non-maximum suppression
@@ -116,6 +205,26 @@ __global__ void non_max_suppression_kernel(unsigned char* gradient, float* direc
     }
 }
 
+// Apply non-maximum suppression using direction sectors
+__global__ void non_max_suppression_sector_kernel(unsigned char* gradient, unsigned char* sector, unsigned char* output, int width, int height) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x < 1 || y < 1 || x >= width - 1 || y >= height - 1) return;
+
+    int i = y * width + x;
+    unsigned char mag = gradient[i];
+    unsigned char m1, m2;
+
+    switch (sector[i]) {
+        case SECTOR_HORIZONTAL: m1 = gradient[i + 1];         m2 = gradient[i - 1];         break;
+        case SECTOR_DIAG_UP:    m1 = gradient[i - width + 1]; m2 = gradient[i + width - 1]; break;
+        case SECTOR_VERTICAL:   m1 = gradient[i - width];     m2 = gradient[i + width];     break;
+        default:                m1 = gradient[i - width - 1]; m2 = gradient[i + width + 1]; break;
+    }
+
+    output[i] = (mag >= m1 && mag >= m2) ? mag : 0;
+}
+
 // Apply double thresholding
 __global__ void double_threshold_kernel(unsigned char* input, unsigned char* output, int width, int height, unsigned char low_thresh, unsigned char high_thresh) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
@@ -183,6 +292,49 @@ __global__ void edge_tracking_dfs_kernel(unsigned char* input, unsigned char* ou
     }
 }
 
+// Hysteresis as a flood fill: the thread of every strong pixel walks the weak
+// pixels connected to it depth first, so a whole chain is followed inside one
+// launch. A pixel is marked strong before it is pushed, so racing threads at
+// worst expand it twice. When a thread's stack is full the pixel it could not
+// hold is strong but not yet expanded: *overflow asks the host for another
+// pass, which restarts from every strong pixel.
+#define FLOOD_STACK 64
+
+__global__ void hysteresis_flood_kernel(unsigned char* edges, int width, int height, int* overflow) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x < 1 || y < 1 || x >= width - 1 || y >= height - 1) return;
+    if (edges[y * width + x] != STRONG_EDGE) return;
+
+    int stack[FLOOD_STACK];
+    int top = 0;
+    stack[top++] = y * width + x;
+    while (top > 0) {
+        int p = stack[--top];
+        int px = p % width, py = p / width;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int nx = px + dx, ny = py + dy;
+                if (nx < 1 || ny < 1 || nx >= width - 1 || ny >= height - 1) continue;
+                int n = ny * width + nx;
+                if (edges[n] != WEAK_EDGE) continue;
+                edges[n] = STRONG_EDGE;
+                if (top < FLOOD_STACK)
+                    stack[top++] = n;
+                else
+                    *overflow = 1;
+            }
+        }
+    }
+}
+
+// Clear weak pixels that were never connected to a strong edge
+__global__ void hysteresis_cleanup_kernel(unsigned char* edges, int width, int height) {
+    int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= width * height) return;
+    if (edges[idx] == WEAK_EDGE) edges[idx] = 0;
+}
+
 // Temporal Linking Kernel
 __global__ void temporal_link_kernel(unsigned char* curr_edge, unsigned char* prev_edge, unsigned char* output, int width, int height) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
@@ -194,38 +346,142 @@ __global__ void temporal_link_kernel(unsigned char* curr_edge, unsigned char* pr
         output[idx] = 0;    // Suppress unstable edge
 }
 
+// Device scratch owned by a cuda_canny_context. Buffers are sized for the
+// largest frame seen so far and only grow, so same-sized frames run without
+// any cudaMalloc / cudaFree.
+struct cuda_canny_context {
+    size_t pixels;            // frame buffers hold this many pixels
+    size_t input_bytes;       // d_input holds this many bytes
+    unsigned char *d_input, *d_gray, *d_blur, *d_edge, *d_nms, *d_thresh, *d_final, *d_cleaned, *d_prev_edge, *d_temporal;
+    unsigned char* d_sector;
+    float* d_direction;       // allocated on first use (CANNY_DIRECTION=float)
+    unsigned int* d_hist;
+    int* d_overflow;          // set by hysteresis_flood_kernel
+};
+
+static void free_frame_buffers(cuda_canny_context* ctx) {
+    cudaFree(ctx->d_gray);
+    cudaFree(ctx->d_blur);
+    cudaFree(ctx->d_edge);
+    cudaFree(ctx->d_nms);
+    cudaFree(ctx->d_thresh);
+    cudaFree(ctx->d_final);
+    cudaFree(ctx->d_cleaned);
+    cudaFree(ctx->d_prev_edge);
+    cudaFree(ctx->d_temporal);
+    cudaFree(ctx->d_sector);
+    cudaFree(ctx->d_direction);
+    ctx->d_direction = NULL;
+}
+
+// Grow the device buffers to fit a width x height x channels frame
+static void context_reserve(cuda_canny_context* ctx, int width, int height, int channels, bool need_direction) {
+    size_t pixels = (size_t)width * height;
+    if (pixels > ctx->pixels) {
+        free_frame_buffers(ctx);
+        cudaMalloc(&ctx->d_gray, pixels);
+        cudaMalloc(&ctx->d_blur, pixels);
+        cudaMalloc(&ctx->d_edge, pixels);
+        cudaMalloc(&ctx->d_nms, pixels);
+        cudaMalloc(&ctx->d_thresh, pixels);
+        cudaMalloc(&ctx->d_final, pixels);
+        cudaMalloc(&ctx->d_cleaned, pixels);
+        cudaMalloc(&ctx->d_prev_edge, pixels);
+        cudaMalloc(&ctx->d_temporal, pixels);
+        cudaMalloc(&ctx->d_sector, pixels);
+        ctx->pixels = pixels;
+    }
+    if (need_direction && !ctx->d_direction) cudaMalloc(&ctx->d_direction, ctx->pixels * sizeof(float));
+
+    if (pixels * channels > ctx->input_bytes) {
+        cudaFree(ctx->d_input);
+        ctx->input_bytes = pixels * channels;
+        cudaMalloc(&ctx->d_input, ctx->input_bytes);
+    }
+}
+
 extern "C"
-void cuda_canny(unsigned char* input, unsigned char* output, int width, int height, int channels, unsigned char* prev_edge) {
+cuda_canny_context* cuda_canny_create(int max_width, int max_height) {
+    cuda_canny_context* ctx = (cuda_canny_context*)calloc(1, sizeof(cuda_canny_context));
+    cudaMalloc(&ctx->d_hist, MAG_BINS * sizeof(unsigned int));
+    cudaMalloc(&ctx->d_overflow, sizeof(int));
+    if (max_width > 0 && max_height > 0) {
+        context_reserve(ctx, max_width, max_height, 4,
+                        strcmp(env_str("CANNY_DIRECTION", "sector"), "float") == 0);
+    }
+    return ctx;
+}
+
+extern "C"
+void cuda_canny_destroy(cuda_canny_context* ctx) {
+    if (!ctx) return;
+    free_frame_buffers(ctx);
+    cudaFree(ctx->d_input);
+    cudaFree(ctx->d_hist);
+    cudaFree(ctx->d_overflow);
+    free(ctx);
+}
+
+extern "C"
+void cuda_canny_run(cuda_canny_context* ctx, unsigned char* input, unsigned char* output,
+                    int width, int height, int channels, unsigned char* prev_edge) {
     int img_size = width * height;
-    unsigned char *d_input, *d_gray, *d_blur, *d_edge, *d_nms, *d_thresh, *d_final, *d_cleaned, *d_prev_edge, *d_temporal;
-    float* d_direction;
-
-    cudaMalloc(&d_input, img_size * channels);
-    cudaMalloc(&d_gray, img_size);
-    cudaMalloc(&d_blur, img_size);
-    cudaMalloc(&d_edge, img_size);
-    cudaMalloc(&d_nms, img_size);
-    cudaMalloc(&d_thresh, img_size);
-    cudaMalloc(&d_final, img_size);
-    cudaMalloc(&d_cleaned, img_size);
-    cudaMalloc(&d_prev_edge, img_size);
-    cudaMalloc(&d_temporal, img_size);
-    cudaMalloc(&d_direction, img_size * sizeof(float));
+
+    // CANNY_DIRECTION=float keeps the atan2f angle buffer; the default stores
+    // one byte per pixel (same edges, 4x less direction traffic)
+    bool use_sector = strcmp(env_str("CANNY_DIRECTION", "sector"), "float") != 0;
+    // CANNY_TRACKING=twopass keeps the two fixed edge-tracking passes
+    bool use_hysteresis = strcmp(env_str("CANNY_TRACKING", "hysteresis"), "twopass") != 0;
+    // CANNY_THRESHOLDS=otsu|percentile picks the thresholds from the Sobel
+    // magnitude histogram (see canny_common.h)
+    int threshold_mode = threshold_mode_from_name(env_str("CANNY_THRESHOLDS", "fixed"));
+    unsigned char low_thresh = env_int("CANNY_LOW", DEFAULT_LOW_THRESH);
+    unsigned char high_thresh = env_int("CANNY_HIGH", DEFAULT_HIGH_THRESH);
+
+    context_reserve(ctx, width, height, channels, !use_sector);
+    unsigned char *d_input = ctx->d_input, *d_gray = ctx->d_gray, *d_blur = ctx->d_blur, *d_edge = ctx->d_edge;
+    unsigned char *d_nms = ctx->d_nms, *d_thresh = ctx->d_thresh, *d_final = ctx->d_final, *d_cleaned = ctx->d_cleaned;
+    unsigned char *d_prev_edge = ctx->d_prev_edge, *d_temporal = ctx->d_temporal;
+    unsigned char* d_sector = ctx->d_sector;
+    float* d_direction = ctx->d_direction;
+    unsigned int* d_hist = NULL;
+    if (threshold_mode != THRESH_FIXED) {
+        d_hist = ctx->d_hist;
+        cudaMemset(d_hist, 0, MAG_BINS * sizeof(unsigned int));
+    }
 
     cudaMemcpy(d_input, input, img_size * channels, cudaMemcpyHostToDevice);
 
     int threads = 256;
     int blocks = (img_size + threads - 1) / threads;
-    rgb_to_gray_kernel<<<blocks, threads>>>(d_input, d_gray, width, height, channels);
+    launch_rgb_to_gray(d_input, d_gray, width, height, channels);
+
+    // Kernels skip border pixels: give those a defined value so the output
+    // does not depend on leftover device memory (and matches cpu_canny)
+    cudaMemcpy(d_blur, d_gray, img_size, cudaMemcpyDeviceToDevice);
+    cudaMemset(d_edge, 0, img_size);
+    cudaMemset(d_nms, 0, img_size);
+    cudaMemset(d_final, 0, img_size);
 
     dim3 threadsPerBlock(16, 16);
     dim3 numBlocks((width + 15) / 16, (height + 15) / 16);
     gaussian_blur_kernel_5x5<<<numBlocks, threadsPerBlock>>>(d_gray, d_blur, width, height);
-    sobel_kernel<<<numBlocks, threadsPerBlock>>>(d_blur, d_edge, d_direction, width, height);
-    non_max_suppression_kernel<<<numBlocks, threadsPerBlock>>>(d_edge, d_direction, d_nms, width, height);
+    if (use_sector) {
+        sobel_sector_kernel<<<numBlocks, threadsPerBlock>>>(d_blur, d_edge, d_sector, width, height, d_hist);
+        non_max_suppression_sector_kernel<<<numBlocks, threadsPerBlock>>>(d_edge, d_sector, d_nms, width, height);
+    } else {
+        sobel_kernel<<<numBlocks, threadsPerBlock>>>(d_blur, d_edge, d_direction, width, height, d_hist);
+        non_max_suppression_kernel<<<numBlocks, threadsPerBlock>>>(d_edge, d_direction, d_nms, width, height);
+    }
 
-    // Apply double thresholding: low = 50, high = 100
-    double_threshold_kernel<<<blocks, threads>>>(d_nms, d_thresh, width, height, 50, 100);
+    if (d_hist) {
+        unsigned int hist[MAG_BINS];
+        cudaMemcpy(hist, d_hist, sizeof(hist), cudaMemcpyDeviceToHost);
+        thresholds_from_histogram(hist, threshold_mode, env_int("CANNY_PERCENTILE", 70), &low_thresh, &high_thresh);
+    }
+
+    // Apply double thresholding (default low = 50, high = 100)
+    double_threshold_kernel<<<blocks, threads>>>(d_nms, d_thresh, width, height, low_thresh, high_thresh);
 
     // Suppress weak clusters
     suppress_weak_clusters_kernel<<<numBlocks, threadsPerBlock>>>(d_thresh, d_cleaned, width, height);
@@ -233,23 +489,33 @@ void cuda_canny(unsigned char* input, unsigned char* output, int width, int heig
     // Temporal link kernel
     temporal_link_kernel<<<blocks, threads>>>(d_thresh, d_prev_edge, d_temporal, width, height);
 
-    // Run edge tracking 2 iterations
-    edge_tracking_dfs_kernel<<<numBlocks, threadsPerBlock>>>(d_thresh, d_final, width, height);
-    edge_tracking_dfs_kernel<<<numBlocks, threadsPerBlock>>>(d_final, d_thresh, width, height);
+    if (use_hysteresis) {
+        // One flood pass follows every chain; another is only needed when
+        // a thread's stack overflowed on a very branchy region
+        int overflow = 1;
+        while (overflow) {
+            cudaMemset(ctx->d_overflow, 0, sizeof(int));
+            hysteresis_flood_kernel<<<numBlocks, threadsPerBlock>>>(d_thresh, width, height, ctx->d_overflow);
+            cudaMemcpy(&overflow, ctx->d_overflow, sizeof(int), cudaMemcpyDeviceToHost);
+        }
+        hysteresis_cleanup_kernel<<<blocks, threads>>>(d_thresh, width, height);
+    } else {
+        // Run edge tracking 2 iterations
+        edge_tracking_dfs_kernel<<<numBlocks, threadsPerBlock>>>(d_thresh, d_final, width, height);
+        edge_tracking_dfs_kernel<<<numBlocks, threadsPerBlock>>>(d_final, d_thresh, width, height);
+    }
 
     cudaMemcpy(output, d_thresh, img_size, cudaMemcpyDeviceToHost);
+}
 
-    cudaFree(d_input);
-    cudaFree(d_gray);
-    cudaFree(d_blur);
-    cudaFree(d_edge);
-    cudaFree(d_nms);
-    cudaFree(d_thresh);
-    cudaFree(d_final);
-    cudaFree(d_cleaned);
-    cudaFree(d_direction);
+extern "C"
+void cuda_canny(unsigned char* input, unsigned char* output, int width, int height, int channels, unsigned char* prev_edge) {
+    cuda_canny_context* ctx = cuda_canny_create(0, 0);
+    cuda_canny_run(ctx, input, output, width, height, channels, prev_edge);
+    cuda_canny_destroy(ctx);
 }
 
+
 //  Basic segmentation kernel
 __global__ void segment_threshold_kernel(unsigned char* input, unsigned char* mask, int width, int height, int threshold) {
     int idx = blockIdx.x * blockDim.x + threadIdx.x;
@@ -258,26 +524,28 @@ __global__ void segment_threshold_kernel(unsigned char* input, unsigned char* ma
     mask[idx] = (input[idx] >= threshold) ? 255 : 0;
 }
 
+// Segmentation reuses the Canny context's input, gray and NMS buffers
 extern "C"
-void cuda_segment(unsigned char* input, unsigned char* output_mask, int w, int h, int c, unsigned char threshold) {
+void cuda_segment_run(cuda_canny_context* ctx, unsigned char* input, unsigned char* output_mask,
+                      int w, int h, int c, unsigned char threshold) {
     int img_size = w * h;
-    unsigned char *d_input, *d_gray, *d_mask;
-
-    cudaMalloc(&d_input, img_size * c);
-    cudaMalloc(&d_gray, img_size);
-    cudaMalloc(&d_mask, img_size);
+    context_reserve(ctx, w, h, c, false);
+    unsigned char *d_input = ctx->d_input, *d_gray = ctx->d_gray, *d_mask = ctx->d_nms;
 
     cudaMemcpy(d_input, input, img_size * c, cudaMemcpyHostToDevice);
 
     int threads = 256;
     int blocks = (img_size + threads - 1) / threads;
 
-    rgb_to_gray_kernel<<<blocks, threads>>>(d_input, d_gray, w, h, c);
+    launch_rgb_to_gray(d_input, d_gray, w, h, c);
     segment_threshold_kernel<<<blocks, threads>>>(d_gray, d_mask, w, h, threshold);
 
     cudaMemcpy(output_mask, d_mask, img_size, cudaMemcpyDeviceToHost);
+}
 
-    cudaFree(d_input);
-    cudaFree(d_gray);
-    cudaFree(d_mask);
+extern "C"
+void cuda_segment(unsigned char* input, unsigned char* output_mask, int w, int h, int c, unsigned char threshold) {
+    cuda_canny_context* ctx = cuda_canny_create(0, 0);
+    cuda_segment_run(ctx, input, output_mask, w, h, c, threshold);
+    cuda_canny_destroy(ctx);
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <string.h>
+#include "edge_codec.h"
+#include "cpu_kernels.h"
+
+size_t edge_encode_bound(size_t pixels) {
+    return 1 + pixels;
+}
+
+static size_t put_varint(unsigned char* out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static int get_varint(const unsigned char** p, const unsigned char* end, uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char byte = *(*p)++;
+        *v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// Run-length encode into out; 0 if that would take more than limit bytes
+static size_t encode_runs(const cpu_kernel_table* K, const unsigned char* edges, size_t pixels,
+                          unsigned char* out, size_t limit) {
+    size_t size = 0, i = 0;
+    int edge = 0;
+    while (i < pixels) {
+        size_t run = K->edge_run(edges + i, pixels - i, edge);
+        if (size + 10 > limit) return 0;   // a varint takes at most 10 bytes
+        size += put_varint(out + size, run);
+        i += run;
+        edge = !edge;
+    }
+    return size;
+}
+
+size_t edge_encode(const unsigned char* edges, size_t pixels, unsigned char* out) {
+    const cpu_kernel_table* K = cpu_kernels();
+    if (!K->edge_is_binary(edges, pixels)) {
+        out[0] = EDGE_WIRE_RAW;
+        memcpy(out + 1, edges, pixels);
+        return 1 + pixels;
+    }
+
+    size_t bits_size = (pixels + 7) / 8;
+    size_t runs_size = bits_size > 1 ? encode_runs(K, edges, pixels, out + 1, bits_size - 1) : 0;
+    if (runs_size > 0) {
+        out[0] = EDGE_WIRE_RUNS;
+        return 1 + runs_size;
+    }
+    out[0] = EDGE_WIRE_BITS;
+    K->edge_bits(edges, out + 1, pixels);
+    return 1 + bits_size;
+}
+
+int edge_decode(const unsigned char* in, size_t size, unsigned char* edges, size_t pixels) {
+    if (size < 1) return -1;
+    const unsigned char* p = in + 1;
+    const unsigned char* end = in + size;
+
+    switch (in[0]) {
+    case EDGE_WIRE_RAW:
+        if (size != 1 + pixels) return -1;
+        memcpy(edges, p, pixels);
+        return 0;
+    case EDGE_WIRE_BITS:
+        if (size != 1 + (pixels + 7) / 8) return -1;
+        cpu_kernels()->edge_expand(p, edges, pixels);
+        return 0;
+    case EDGE_WIRE_RUNS: {
+        size_t i = 0;
+        int edge = 0;
+        while (p < end) {
+            uint64_t run;
+            if (get_varint(&p, end, &run) != 0 || run > pixels - i) return -1;
+            memset(edges + i, edge ? 255 : 0, run);
+            i += run;
+            edge = !edge;
+        }
+        return i == pixels ? 0 : -1;
+    }
+    default:
+        return -1;
+    }
+}
@@ -1,14 +1,332 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "frame_pool.h"
+
+// stb_image allocations are routed through these so that load_image_pooled
+// can place the decoded image, and the component planes the JPEG decoder
+// works in, in pool buffers
+static void* stbi_pool_malloc(size_t size);
+static void* stbi_pool_realloc(void* ptr, size_t old_size, size_t size);
+static void stbi_pool_free(void* ptr);
+#define STBI_MALLOC(size) stbi_pool_malloc(size)
+#define STBI_REALLOC_SIZED(ptr, old_size, size) stbi_pool_realloc(ptr, old_size, size)
+#define STBI_FREE(ptr) stbi_pool_free(ptr)
+
 #include "stb_image.h"
 #include "stb_image_write.h"
+#include "frame_io.h"
+#include "frame_pack.h"
+#include "utils.h"
+
+// Packs opened by load_image stay mapped until the process exits
+#define MAX_OPEN_PACKS 8
+static frame_pack* open_packs[MAX_OPEN_PACKS];
+static char open_pack_paths[MAX_OPEN_PACKS][MAX_FILENAME_LEN];
+static int num_open_packs;
+static pthread_mutex_t packs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static frame_pack* get_pack(const char* path) {
+    frame_pack* pack = NULL;
+    pthread_mutex_lock(&packs_lock);
+    for (int i = 0; i < num_open_packs && !pack; i++) {
+        if (strcmp(open_pack_paths[i], path) == 0) pack = open_packs[i];
+    }
+    if (!pack && num_open_packs < MAX_OPEN_PACKS && (pack = frame_pack_open(path)) != NULL) {
+        snprintf(open_pack_paths[num_open_packs], MAX_FILENAME_LEN, "%s", path);
+        open_packs[num_open_packs++] = pack;
+    }
+    pthread_mutex_unlock(&packs_lock);
+    return pack;
+}
 
 unsigned char* load_image(const char* filename, int* w, int* h, int* channels) {
+    // "<pack>#<index>": zero-copy pointer into the mapped pack
+    const char* hash = strrchr(filename, '#');
+    if (hash) {
+        char path[MAX_FILENAME_LEN];
+        snprintf(path, sizeof(path), "%.*s", (int)(hash - filename), filename);
+        frame_pack* pack = get_pack(path);
+        const unsigned char* frame = pack ? frame_pack_frame(pack, atoi(hash + 1)) : NULL;
+        if (!frame) return NULL;
+        *w = pack->header.width;
+        *h = pack->header.height;
+        *channels = pack->header.channels;
+        return (unsigned char*)frame;
+    }
     return stbi_load(filename, w, h, channels, 0);
 }
 
-void save_image(const char* filename, unsigned char* data, int w, int h, int channels) {
+void free_image(unsigned char* img) {
+    if (!img) return;
+    pthread_mutex_lock(&packs_lock);
+    for (int i = 0; i < num_open_packs; i++) {
+        uintptr_t base = (uintptr_t)open_packs[i]->base;
+        if ((uintptr_t)img >= base && (uintptr_t)img < base + open_packs[i]->size) {
+            pthread_mutex_unlock(&packs_lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&packs_lock);
+    stbi_image_free(img);
+}
+
+// Pool the current thread is decoding into; allocations smaller than
+// POOLED_ALLOC_MIN (Huffman tables, row pointers) stay with malloc
+#define POOLED_ALLOC_MIN 4096
+static __thread frame_pool* decode_pool;
+
+static void* stbi_pool_malloc(size_t size) {
+    if (decode_pool && size >= POOLED_ALLOC_MIN) return frame_pool_get(decode_pool, size);
+    return malloc(size);
+}
+
+static void stbi_pool_free(void* ptr) {
+    if (ptr && decode_pool && frame_pool_put(decode_pool, ptr)) return;
+    free(ptr);
+}
+
+static void* stbi_pool_realloc(void* ptr, size_t old_size, size_t size) {
+    if (!ptr || !decode_pool) return realloc(ptr, size);
+
+    // Move to a new allocation, then hand the old one back to wherever it came from
+    void* moved = stbi_pool_malloc(size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    stbi_pool_free(ptr);
+    return moved;
+}
+
+unsigned char* load_image_pooled(frame_pool* pool, const char* filename, int* w, int* h, int* channels) {
+    if (strrchr(filename, '#')) return load_image(filename, w, h, channels);
+    decode_pool = pool;
+    unsigned char* img = stbi_load(filename, w, h, channels, 0);
+    decode_pool = NULL;
+    return img;
+}
+
+void free_pooled_image(frame_pool* pool, unsigned char* img) {
+    if (img && !frame_pool_put(pool, img)) free_image(img);
+}
+
+void save_image(const char* filename, const unsigned char* data, int w, int h, int channels) {
     stbi_write_jpg(filename, w, h, channels, data, 100);
 }
 
+// Built once: loader threads call frame_input_pattern concurrently
+static char pack_pattern[MAX_FILENAME_LEN];
+static pthread_once_t pack_pattern_once = PTHREAD_ONCE_INIT;
+
+static void init_pack_pattern(void) {
+    const char* pack = env_str("FRAME_PACK", NULL);
+    if (pack) snprintf(pack_pattern, sizeof(pack_pattern), "%s#%%d", pack);
+}
+
+const char* frame_input_pattern(void) {
+    pthread_once(&pack_pattern_once, init_pack_pattern);
+    if (!pack_pattern[0]) return env_str("FRAME_PATTERN", "frames/frame_%04d.jpg");
+    return pack_pattern;
+}
+
+int frame_input_pack_count(void) {
+    const char* path = env_str("FRAME_PACK", NULL);
+    frame_pack* pack = path ? get_pack(path) : NULL;
+    return pack ? (int)pack->header.frame_count : -1;
+}
+
+static const char* edge_format_names[] = { "jpg", "pgm", "pbm", "raw", "bitpack" };
+#define NUM_EDGE_FORMATS (int)(sizeof(edge_format_names) / sizeof(edge_format_names[0]))
+
+edge_format edge_output_format(void) {
+    const char* name = env_str("OUTPUT_FORMAT", "jpg");
+    for (int i = 0; i < NUM_EDGE_FORMATS; i++) {
+        if (strcmp(name, edge_format_names[i]) == 0) return (edge_format)i;
+    }
+    return EDGE_FORMAT_JPG;
+}
+
+void edge_output_path(char* path, size_t size, const char* pattern, int index) {
+    if (edge_output_format() == EDGE_FORMAT_BITPACK) {
+        const char* slash = strrchr(pattern, '/');
+        if (slash)
+            snprintf(path, size, "%.*s/edges.bitpack", (int)(slash - pattern), pattern);
+        else
+            snprintf(path, size, "edges.bitpack");
+        return;
+    }
+    int n = snprintf(path, size, pattern, index);
+    if (n >= 0 && (size_t)n < size) snprintf(path + n, size - n, ".%s", edge_format_names[edge_output_format()]);
+}
+
+void pack_edge_bits(const unsigned char* in, unsigned char* out, int n) {
+    int full = n / 8;
+    for (int i = 0; i < full; i++) {
+        const unsigned char* p = in + 8 * i;
+        out[i] = (unsigned char)((p[0] >> 7) << 7 | (p[1] >> 7) << 6 | (p[2] >> 7) << 5 | (p[3] >> 7) << 4 |
+                                 (p[4] >> 7) << 3 | (p[5] >> 7) << 2 | (p[6] >> 7) << 1 | (p[7] >> 7));
+    }
+    if (n % 8) {
+        unsigned char last = 0;
+        for (int b = 0; b < n % 8; b++) last |= (in[8 * full + b] >> 7) << (7 - b);
+        out[full] = last;
+    }
+}
+
+void edge_scratch_free(edge_scratch* scratch) {
+    free(scratch->bits);
+    scratch->bits = NULL;
+    scratch->capacity = 0;
+}
+
+// Rows packed at 1 bit per pixel, each starting on a byte, in scratch
+static unsigned char* pack_edge_rows(edge_scratch* scratch, const unsigned char* edges, int width, int height,
+                                     size_t* bytes) {
+    size_t row_bytes = (width + 7) / 8;
+    if (row_bytes * height > scratch->capacity) {
+        free(scratch->bits);
+        scratch->capacity = row_bytes * height;
+        scratch->bits = malloc(scratch->capacity);
+    }
+    unsigned char* bits = scratch->bits;
+    for (int y = 0; y < height; y++) pack_edge_bits(edges + (size_t)y * width, bits + y * row_bytes, width);
+    *bytes = row_bytes * height;
+    return bits;
+}
+
+static int write_file(const char* path, const char* header, const void* data, size_t bytes) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    int ok = (!header || fputs(header, f) != EOF) && fwrite(data, 1, bytes, f) == bytes;
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+// The edges.bitpack container this process writes to, opened on first use
+static int bitpack_fd = -1;
+static char bitpack_path[MAX_FILENAME_LEN];
+static edge_pack_header bitpack_header;
+static uint64_t bitpack_frames;   // highest index this process wrote + 1
+static pthread_mutex_t bitpack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Raise the header's frame count to cover this process's frames and close.
+// Other ranks finish on their own schedule, so the count is updated under a
+// lock on the header. Caller holds bitpack_lock.
+static void close_bitpack(void) {
+    if (bitpack_fd < 0) return;
+    struct flock lock = { .l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = sizeof(edge_pack_header) };
+    fcntl(bitpack_fd, F_SETLKW, &lock);
+    edge_pack_header header;
+    if (pread(bitpack_fd, &header, sizeof(header), 0) == sizeof(header) && header.frame_count < bitpack_frames) {
+        header.frame_count = bitpack_frames;
+        if (pwrite(bitpack_fd, &header, sizeof(header), 0) != sizeof(header))
+            log_error("Failed to update the frame count of %s", bitpack_path);
+    }
+    lock.l_type = F_UNLCK;
+    fcntl(bitpack_fd, F_SETLK, &lock);
+    close(bitpack_fd);
+    bitpack_fd = -1;
+    bitpack_frames = 0;
+}
+
+void edge_output_begin(const char* pattern) {
+    if (edge_output_format() != EDGE_FORMAT_BITPACK) return;
+    char path[MAX_FILENAME_LEN];
+    edge_output_path(path, sizeof(path), pattern, 0);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        log_error("Failed to create %s", path);
+    else
+        close(fd);
+}
+
+void edge_output_end(void) {
+    pthread_mutex_lock(&bitpack_lock);
+    close_bitpack();
+    pthread_mutex_unlock(&bitpack_lock);
+}
+
+static int save_bitpack(edge_scratch* scratch, const char* path, int index, const unsigned char* edges, int width,
+                        int height) {
+    pthread_mutex_lock(&bitpack_lock);
+    if (bitpack_fd < 0 || strcmp(bitpack_path, path) != 0) {
+        close_bitpack();
+        bitpack_fd = open(path, O_RDWR | O_CREAT, 0644);
+        snprintf(bitpack_path, sizeof(bitpack_path), "%s", path);
+        memcpy(bitpack_header.magic, EDGE_PACK_MAGIC, sizeof(bitpack_header.magic));
+        bitpack_header.width = width;
+        bitpack_header.height = height;
+        bitpack_header.frame_bytes = (uint64_t)height * ((width + 7) / 8);
+
+        // Every writer stores the same header up to the frame count, which
+        // close_bitpack maintains, so concurrent ranks agree
+        size_t fixed = offsetof(edge_pack_header, frame_count);
+        if (bitpack_fd >= 0 && pwrite(bitpack_fd, &bitpack_header, fixed, 0) != (ssize_t)fixed) {
+            close(bitpack_fd);
+            bitpack_fd = -1;
+        }
+    }
+    int fd = bitpack_fd;
+    int same_size = (uint32_t)width == bitpack_header.width && (uint32_t)height == bitpack_header.height;
+    if (fd >= 0 && same_size && (uint64_t)index + 1 > bitpack_frames) bitpack_frames = (uint64_t)index + 1;
+    pthread_mutex_unlock(&bitpack_lock);
+
+    if (fd < 0) return -1;
+    if (!same_size) {
+        log_error("%s holds %ux%u frames; frame %d is %dx%d", path, bitpack_header.width, bitpack_header.height,
+                  index, width, height);
+        return -1;
+    }
+
+    size_t bytes;
+    unsigned char* bits = pack_edge_rows(scratch, edges, width, height, &bytes);
+    off_t offset = sizeof(edge_pack_header) + (off_t)index * bytes;
+    return pwrite(fd, bits, bytes, offset) == (ssize_t)bytes ? 0 : -1;
+}
+
+int save_edges(const char* pattern, int index, const unsigned char* edges, int width, int height) {
+    edge_scratch scratch = {0};
+    int status = save_edges_scratch(&scratch, pattern, index, edges, width, height);
+    edge_scratch_free(&scratch);
+    return status;
+}
+
+int save_edges_scratch(edge_scratch* scratch, const char* pattern, int index, const unsigned char* edges,
+                       int width, int height) {
+    char path[MAX_FILENAME_LEN];
+    edge_output_path(path, sizeof(path), pattern, index);
+
+    char header[64];
+    size_t bytes;
+    int status;
+    switch (edge_output_format()) {
+    case EDGE_FORMAT_PGM:
+        snprintf(header, sizeof(header), "P5\n%d %d\n255\n", width, height);
+        status = write_file(path, header, edges, (size_t)width * height);
+        break;
+    case EDGE_FORMAT_PBM: {
+        // PBM draws 1 as black: invert so edges stay white as in the other formats
+        unsigned char* bits = pack_edge_rows(scratch, edges, width, height, &bytes);
+        for (size_t i = 0; i < bytes; i++) bits[i] = ~bits[i];
+        snprintf(header, sizeof(header), "P4\n%d %d\n", width, height);
+        status = write_file(path, header, bits, bytes);
+        break;
+    }
+    case EDGE_FORMAT_RAW:
+        status = write_file(path, NULL, edges, (size_t)width * height);
+        break;
+    case EDGE_FORMAT_BITPACK:
+        status = save_bitpack(scratch, path, index, edges, width, height);
+        break;
+    default:
+        status = stbi_write_jpg(path, width, height, 1, edges, 100) ? 0 : -1;
+        break;
+    }
+    if (status != 0) log_error("Failed to write %s", path);
+    return status;
+}
+
 // Get headers: https://github.com/nothings/stb
\ No newline at end of file
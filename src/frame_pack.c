@@ -0,0 +1,115 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "frame_pack.h"
+#include "utils.h"
+
+struct frame_pack_writer {
+    FILE* file;
+    frame_pack_header header;
+    unsigned char* padding;   // zeros up to the next frame boundary
+};
+
+static uint64_t align_up(uint64_t n) {
+    return (n + FRAME_PACK_ALIGN - 1) / FRAME_PACK_ALIGN * FRAME_PACK_ALIGN;
+}
+
+frame_pack* frame_pack_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("Failed to open frame pack %s", path);
+        return NULL;
+    }
+
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(frame_pack_header)) {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);   // the mapping keeps the file alive
+    if (base == MAP_FAILED) {
+        log_error("Failed to map frame pack %s", path);
+        return NULL;
+    }
+
+    frame_pack* pack = calloc(1, sizeof(frame_pack));
+    memcpy(&pack->header, base, sizeof(frame_pack_header));
+    pack->base = base;
+    pack->size = st.st_size;
+
+    const frame_pack_header* h = &pack->header;
+    uint64_t frame_bytes = (uint64_t)h->width * h->height * h->channels;
+    if (memcmp(h->magic, FRAME_PACK_MAGIC, sizeof(h->magic)) != 0 || frame_bytes == 0 ||
+        h->frame_stride < frame_bytes ||
+        h->data_offset + (uint64_t)h->frame_count * h->frame_stride > pack->size) {
+        log_error("%s is not a valid frame pack", path);
+        frame_pack_close(pack);
+        return NULL;
+    }
+    return pack;
+}
+
+void frame_pack_close(frame_pack* pack) {
+    if (!pack) return;
+    munmap((void*)pack->base, pack->size);
+    free(pack);
+}
+
+const unsigned char* frame_pack_frame(const frame_pack* pack, int index) {
+    if (index < 0 || (uint32_t)index >= pack->header.frame_count) return NULL;
+    const unsigned char* frame = pack->base + pack->header.data_offset + (uint64_t)index * pack->header.frame_stride;
+
+    // Start reading this frame's pages now instead of one fault at a time
+    // (frames are page aligned, see FRAME_PACK_ALIGN)
+    madvise((void*)frame, pack->header.frame_stride, MADV_WILLNEED);
+    return frame;
+}
+
+frame_pack_writer* frame_pack_create(const char* path, int width, int height, int channels) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        log_error("Failed to create frame pack %s", path);
+        return NULL;
+    }
+
+    frame_pack_writer* w = calloc(1, sizeof(frame_pack_writer));
+    w->file = file;
+    memcpy(w->header.magic, FRAME_PACK_MAGIC, sizeof(w->header.magic));
+    w->header.width = width;
+    w->header.height = height;
+    w->header.channels = channels;
+    w->header.frame_stride = align_up((uint64_t)width * height * channels);
+    w->header.data_offset = align_up(sizeof(frame_pack_header));
+    w->padding = calloc(1, FRAME_PACK_ALIGN);
+
+    // Header (frame count filled in by frame_pack_finish) and its padding
+    fwrite(&w->header, sizeof(frame_pack_header), 1, file);
+    fwrite(w->padding, 1, w->header.data_offset - sizeof(frame_pack_header), file);
+    return w;
+}
+
+int frame_pack_append(frame_pack_writer* w, const unsigned char* pixels) {
+    size_t frame_bytes = (size_t)w->header.width * w->header.height * w->header.channels;
+    size_t pad = w->header.frame_stride - frame_bytes;
+    if (fwrite(pixels, 1, frame_bytes, w->file) != frame_bytes ||
+        fwrite(w->padding, 1, pad, w->file) != pad) {
+        return -1;
+    }
+    w->header.frame_count++;
+    return 0;
+}
+
+int frame_pack_finish(frame_pack_writer* w) {
+    int count = w->header.frame_count;
+    if (fseek(w->file, 0, SEEK_SET) != 0 || fwrite(&w->header, sizeof(frame_pack_header), 1, w->file) != 1) {
+        count = -1;
+    }
+    if (fclose(w->file) != 0) count = -1;
+    free(w->padding);
+    free(w);
+    return count;
+}
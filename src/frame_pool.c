@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "frame_pool.h"
+#include "utils.h"
+
+// Buffers the pool keeps track of; requests beyond that are plain allocations
+#define MAX_POOL_BUFFERS 64
+
+typedef struct {
+    void* ptr;
+    size_t capacity;
+    int in_use;
+} pool_buffer;
+
+struct frame_pool {
+    pool_buffer buffers[MAX_POOL_BUFFERS];
+    int count;
+    long hits, misses;
+    pthread_mutex_t lock;
+};
+
+static void* aligned_buffer(size_t bytes) {
+    void* ptr = NULL;
+    bytes = (bytes + FRAME_POOL_ALIGN - 1) / FRAME_POOL_ALIGN * FRAME_POOL_ALIGN;
+    return posix_memalign(&ptr, FRAME_POOL_ALIGN, bytes ? bytes : FRAME_POOL_ALIGN) == 0 ? ptr : NULL;
+}
+
+frame_pool* frame_pool_create(void) {
+    frame_pool* pool = calloc(1, sizeof(frame_pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void frame_pool_destroy(frame_pool* pool) {
+    if (!pool) return;
+    for (int i = 0; i < pool->count; i++) free(pool->buffers[i].ptr);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void* frame_pool_get(frame_pool* pool, size_t bytes) {
+    pthread_mutex_lock(&pool->lock);
+
+    // Smallest free buffer that fits, else a free one to replace
+    pool_buffer* best = NULL;
+    pool_buffer* spare = NULL;
+    for (int i = 0; i < pool->count; i++) {
+        pool_buffer* b = &pool->buffers[i];
+        if (b->in_use) continue;
+        if (b->capacity >= bytes) {
+            if (!best || b->capacity < best->capacity) best = b;
+        } else if (!spare) {
+            spare = b;
+        }
+    }
+
+    void* ptr = NULL;
+    if (best) {
+        pool->hits++;
+        best->in_use = 1;
+        ptr = best->ptr;
+    } else {
+        pool->misses++;
+        if (!spare && pool->count < MAX_POOL_BUFFERS) spare = &pool->buffers[pool->count++];
+        if (spare) {
+            free(spare->ptr);
+            spare->ptr = aligned_buffer(bytes);
+            spare->capacity = spare->ptr ? bytes : 0;
+            spare->in_use = spare->ptr != NULL;
+            ptr = spare->ptr;
+        } else {
+            ptr = aligned_buffer(bytes);   // pool full: the caller's put will free it
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ptr;
+}
+
+int frame_pool_put(frame_pool* pool, void* buf) {
+    int owned = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (int i = 0; i < pool->count && !owned; i++) {
+        if (pool->buffers[i].ptr == buf && pool->buffers[i].in_use) {
+            pool->buffers[i].in_use = 0;
+            owned = 1;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return owned;
+}
+
+frame_pool_stats frame_pool_get_stats(frame_pool* pool) {
+    frame_pool_stats stats = {0};
+    pthread_mutex_lock(&pool->lock);
+    stats.hits = pool->hits;
+    stats.misses = pool->misses;
+    for (int i = 0; i < pool->count; i++) {
+        if (!pool->buffers[i].ptr) continue;
+        stats.buffers++;
+        stats.bytes += pool->buffers[i].capacity;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return stats;
+}
+
+void frame_pool_log(frame_pool* pool, const char* tag) {
+    frame_pool_stats s = frame_pool_get_stats(pool);
+    long total = s.hits + s.misses;
+    log_info("%s: Frame pool %ld hits / %ld misses (%.1f%% reused), %d buffers, %.1f MB",
+             tag, s.hits, s.misses, total ? 100.0 * s.hits / total : 0.0, s.buffers, s.bytes / 1048576.0);
+}
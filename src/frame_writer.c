@@ -0,0 +1,153 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "frame_writer.h"
+#include "frame_io.h"
+#include "frame_pool.h"
+#include "utils.h"
+
+typedef struct {
+    char pattern[MAX_FILENAME_LEN];
+    int index;
+    unsigned char* edges;
+    int width, height;
+} write_job;
+
+struct frame_writer {
+    pthread_t* threads;
+    int num_threads;
+
+    // Ring of queued jobs; guarded by lock
+    write_job* jobs;
+    int capacity, head, count;
+    int in_progress;              // jobs taken by a thread but not yet written
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full, idle, buffer_free;
+
+    // Output buffers, at most max_buffers handed out at once
+    frame_pool* buffers;
+    int buffers_out, max_buffers;
+
+    int written;
+    double encode_time;           // busy seconds summed over threads
+    double stall_time;            // seconds submitters waited for room
+};
+
+static void* writer_main(void* arg) {
+    frame_writer* w = arg;
+    edge_scratch scratch = {0};   // this thread's packing buffer
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->count == 0 && !w->closed) pthread_cond_wait(&w->not_empty, &w->lock);
+        if (w->count == 0) break;
+
+        write_job job = w->jobs[w->head];
+        w->head = (w->head + 1) % w->capacity;
+        w->count--;
+        w->in_progress++;
+        pthread_cond_signal(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+
+        double t0 = wall_time();
+        save_edges_scratch(&scratch, job.pattern, job.index, job.edges, job.width, job.height);
+        double busy = wall_time() - t0;
+
+        pthread_mutex_lock(&w->lock);
+        if (!frame_pool_put(w->buffers, job.edges)) free(job.edges);   // beyond the pool's buffers
+        w->buffers_out--;
+        pthread_cond_signal(&w->buffer_free);
+        w->in_progress--;
+        w->written++;
+        w->encode_time += busy;
+        if (w->count == 0 && w->in_progress == 0) pthread_cond_broadcast(&w->idle);
+    }
+    pthread_mutex_unlock(&w->lock);
+    edge_scratch_free(&scratch);
+    return NULL;
+}
+
+frame_writer* frame_writer_create(int threads, int depth) {
+    if (threads < 1) threads = 1;
+    if (depth < 1) depth = 1;
+
+    frame_writer* w = calloc(1, sizeof(frame_writer));
+    w->jobs = malloc(depth * sizeof(write_job));
+    w->capacity = depth;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->not_empty, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    pthread_cond_init(&w->idle, NULL);
+    pthread_cond_init(&w->buffer_free, NULL);
+    w->buffers = frame_pool_create();
+    w->max_buffers = depth + threads + 1;
+
+    w->threads = malloc(threads * sizeof(pthread_t));
+    w->num_threads = threads;
+    for (int i = 0; i < threads; i++) pthread_create(&w->threads[i], NULL, writer_main, w);
+    return w;
+}
+
+frame_writer* frame_writer_from_env(void) {
+    return frame_writer_create(env_int("WRITER_THREADS", 2), env_int("WRITER_DEPTH", 4));
+}
+
+unsigned char* frame_writer_buffer(frame_writer* w, int width, int height) {
+    pthread_mutex_lock(&w->lock);
+    while (w->buffers_out == w->max_buffers) pthread_cond_wait(&w->buffer_free, &w->lock);
+    w->buffers_out++;
+    pthread_mutex_unlock(&w->lock);
+    return frame_pool_get(w->buffers, (size_t)width * height);
+}
+
+void frame_writer_submit(frame_writer* w, const char* pattern, int index, unsigned char* edges,
+                         int width, int height) {
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->capacity) {
+        double t0 = wall_time();
+        while (w->count == w->capacity) pthread_cond_wait(&w->not_full, &w->lock);
+        w->stall_time += wall_time() - t0;
+    }
+
+    write_job* job = &w->jobs[(w->head + w->count) % w->capacity];
+    snprintf(job->pattern, sizeof(job->pattern), "%s", pattern);
+    job->index = index;
+    job->edges = edges;
+    job->width = width;
+    job->height = height;
+    w->count++;
+    pthread_cond_signal(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void frame_writer_flush(frame_writer* w) {
+    pthread_mutex_lock(&w->lock);
+    while (w->count > 0 || w->in_progress > 0) pthread_cond_wait(&w->idle, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void frame_writer_destroy(frame_writer* w, const char* tag) {
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    w->closed = 1;
+    pthread_cond_broadcast(&w->not_empty);
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < w->num_threads; i++) pthread_join(w->threads[i], NULL);
+
+    frame_pool_stats buffers = frame_pool_get_stats(w->buffers);
+    log_info("%s: Writer saved %d images: encode %.2fs (%d thr), submit stalled %.2fs (depth %d) | "
+             "%d output buffers, %.1f MB, %ld reused",
+             tag, w->written, w->encode_time, w->num_threads, w->stall_time, w->capacity,
+             buffers.buffers, buffers.bytes / 1048576.0, buffers.hits);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->not_empty);
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->idle);
+    pthread_cond_destroy(&w->buffer_free);
+    frame_pool_destroy(w->buffers);
+    free(w->threads);
+    free(w->jobs);
+    free(w);
+}
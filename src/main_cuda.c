@@ -6,6 +6,7 @@
 #include "frame_io.h"
 #include "utils.h"
 #include "cuda_filter.h"
+#include "pipeline.h"
 
 #define MAX_FILENAME_LEN 256
 
@@ -27,41 +28,37 @@ int count_frames(const char* folder) {
     return count;
 }
 
-int main() {
-    int total_frames = count_frames("frames");
-    if (total_frames == 0) {
-        fprintf(stderr, "No frames found in 'frames/'\n");
-        return 1;
-    }
-
-    char input_filename[MAX_FILENAME_LEN];
-    char output_filename[MAX_FILENAME_LEN];
+// Compute stage: Canny on the GPU for one decoded frame (arg is the context)
+static void process_frame(frame_job* job, void* arg) {
+    cuda_canny_run(arg, job->img, job->edges, job->width, job->height, job->channels, NULL);  // No temporal linking for now
+}
 
-    double start_time = (double)clock() / CLOCKS_PER_SEC;
+int main() {
+    double start_time = wall_time();
 
-    for (int i = 0; i < total_frames; i++) {
-        snprintf(input_filename, sizeof(input_filename), "frames/frame_%04d.jpg", i);
+    pipeline_config cfg = {0};
+    cfg.input_pattern = frame_input_pattern();
+    cfg.output_pattern = "output/output_cuda/frame_%04d";
+    cfg.tag = "CUDA";
+    cfg.process = process_frame;
+    if (pipeline_config_from_env(&cfg) != 0) return 1;
 
-        int w, h, c;
-        unsigned char* img = load_image(input_filename, &w, &h, &c);
-        if (!img) {
-            log_error("CUDA: Failed to load %s", input_filename);
-            continue;
+    if (!cfg.input_stream) {
+        cfg.total_frames = frame_input_pack_count();
+        if (cfg.total_frames < 0) cfg.total_frames = count_frames("frames");
+        if (cfg.total_frames == 0) {
+            fprintf(stderr, "No frames found in 'frames/'\n");
+            return 1;
         }
-
-        unsigned char* edges = malloc(w * h);
-        cuda_canny(img, edges, w, h, c, NULL);  // No temporal linking for now
-
-        snprintf(output_filename, sizeof(output_filename), "output/output_cuda/frame_%04d.jpg", i);
-        save_image(output_filename, edges, w, h, 1);
-        log_info("CUDA: Saved %s", output_filename);
-
-        free(img);
-        free(edges);
     }
 
-    double end_time = (double)clock() / CLOCKS_PER_SEC;
+    cfg.process_arg = cuda_canny_create(0, 0);
+    int status = run_frame_pipeline(&cfg) < 0 ? 1 : 0;
+    if (pipeline_close_streams(&cfg) != 0) status = 1;
+    cuda_canny_destroy(cfg.process_arg);
+
+    double end_time = wall_time();
     printf("CUDA-only processing took %.2f seconds\n", end_time - start_time);
 
-    return 0;
+    return status;
 }
@@ -3,104 +3,105 @@
 #include <stdlib.h>
 #include <string.h>
 #include "frame_io.h"
+#include "frame_writer.h"
 #include "utils.h"
-#include <dirent.h>
+#include "cpu_filter.h"
+#include "task_queue.h"
 
 
 #define MAX_FILENAME_LEN 256
 #define TAG_TASK 1
 
-// CPU-only filtering
-void simple_edge_filter(unsigned char* input, unsigned char* output, int w, int h, int c) {
-    for (int y = 1; y < h - 1; y++) {
-        for (int x = 1; x < w - 1; x++) {
-            int gx = input[(y * w + (x+1)) * c] - input[(y * w + (x-1)) * c];
-            int gy = input[((y+1) * w + x) * c] - input[((y-1) * w + x) * c];
-            int mag = abs(gx) + abs(gy);
-            output[y * w + x] = (mag > 100) ? 255 : 0;
-        }
-    }
-}
-
-// Count frame
-int count_frames(const char* folder) {
-    int count = 0;
-    DIR* dir = opendir(folder);
-    if (!dir) {
-        perror("Failed to open frames directory");
-        return 0;
-    }
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, "frame_") && strstr(entry->d_name, ".jpg"))
-            count++;
-    }
-
-    closedir(dir);
-    return count;
-}
-
-void master(int total_frames, int world_size) {
-    int frame_index = 0;
-    int active_workers = world_size - 1;
-
-    for (int rank = 1; rank < world_size && frame_index < total_frames; ++rank) {
-        MPI_Send(&frame_index, 1, MPI_INT, rank, TAG_TASK, MPI_COMM_WORLD);
-        frame_index++;
-    }
-
+// Rank 0 owns the task queue (task_queue.h), so FRAME_PACK, FRAME_FIRST /
+// FRAME_LAST and FRAME_MANIFEST pick the frames here as in exec_full. Each
+// worker's first chunk goes out in one MPI_Scatter during startup; after
+// that the master answers each finished chunk with the next one, {first
+// frame, count}, sized by guided_chunk_size. A count of 0 means no work.
+void master(TaskQueue* queue, int active_workers, int world_size) {
+    int chunks_sent = 0;
     while (active_workers > 0) {
         int worker_rank, frame_done;
         MPI_Status status;
         MPI_Recv(&frame_done, 1, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
         worker_rank = status.MPI_SOURCE;
 
-        if (frame_index < total_frames) {
-            MPI_Send(&frame_index, 1, MPI_INT, worker_rank, TAG_TASK, MPI_COMM_WORLD);
-            frame_index++;
+        int chunk[2];
+        chunk[1] = get_next_chunk(queue, world_size - 1, &chunk[0]);
+        if (chunk[1] > 0) {
+            MPI_Send(chunk, 2, MPI_INT, worker_rank, TAG_TASK, MPI_COMM_WORLD);
+            chunks_sent++;
         } else {
-            int dummy = -1;
-            MPI_Send(&dummy, 1, MPI_INT, worker_rank, TAG_TERMINATE, MPI_COMM_WORLD);
+            int dummy[2] = {-1, 0};
+            MPI_Send(dummy, 2, MPI_INT, worker_rank, TAG_TERMINATE, MPI_COMM_WORLD);
             active_workers--;
         }
     }
+    log_info("MASTER: %d chunks after the first ones (chunk size %d..%d)", chunks_sent, queue->min_chunk, queue->max_chunk);
 }
 
-void worker(int rank) {
+// 1 once the frame's edges are computed and queued, 0 if it failed to load
+static int process_frame(int rank, int frame_num, frame_pool* pool, cpu_canny_context* ctx, frame_writer* writer) {
     int w, h, c;
-    int frame_num;
     char input_filename[MAX_FILENAME_LEN];
     char output_filename[MAX_FILENAME_LEN];
 
-    while (1) {
-        MPI_Status status;
-        MPI_Recv(&frame_num, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-
-        if (status.MPI_TAG == TAG_TERMINATE) {
-            break;
-        }
-
-        snprintf(input_filename, sizeof(input_filename), "frames/frame_%04d.jpg", frame_num);
-        unsigned char* img = load_image(input_filename, &w, &h, &c);
-        if (!img) {
-            log_error("WORKER %d: Failed to load frame %s", rank, input_filename);
-            MPI_Send(&frame_num, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-            continue;
-        }
+    snprintf(input_filename, sizeof(input_filename), frame_input_pattern(), frame_num);
+    unsigned char* img = load_image_pooled(pool, input_filename, &w, &h, &c);
+    if (!img) {
+        log_error("WORKER %d: Failed to load frame %s", rank, input_filename);
+        return 0;
+    }
 
-        unsigned char* edges = malloc(w * h);
+    unsigned char* edges = frame_writer_buffer(writer, w, h);   // back to the writer once submitted
+    if (ctx)
+        cpu_canny_run(ctx, img, edges, w, h, c, NULL);
+    else
         simple_edge_filter(img, edges, w, h, c);
 
-        snprintf(output_filename, sizeof(output_filename), "output/output_mpi/frame_%04d.jpg", frame_num);
-        save_image(output_filename, edges, w, h, 1);
-        log_info("WORKER %d: Saved %s", rank, output_filename);
+    edge_output_path(output_filename, sizeof(output_filename), "output/output_mpi/frame_%04d", frame_num);
+    free_pooled_image(pool, img);
+    frame_writer_submit(writer, "output/output_mpi/frame_%04d", frame_num, edges, w, h);
+    log_info("WORKER %d: Queued %s", rank, output_filename);
+    return 1;
+}
 
-        free(img);
-        free(edges);
+// Returns when its first frame was computed, in seconds after ready_time
+// (1e30 if it computed none)
+double worker(int rank, const int first_chunk[2], double ready_time) {
+    // EDGE_FILTER=canny runs the full CPU Canny pipeline instead of the demo filter
+    int use_canny = strcmp(env_str("EDGE_FILTER", "simple"), "canny") == 0;
+    cpu_canny_context* ctx = use_canny ? cpu_canny_create(0, 0) : NULL;
+
+    // Encoding runs on background threads, which recycle the edge maps
+    frame_writer* writer = frame_writer_from_env();
+
+    // Decode buffers are recycled from frame to frame
+    frame_pool* pool = frame_pool_create();
+
+    // After the first chunk, each reply to a finished chunk is the next one
+    // (or TAG_TERMINATE)
+    double first_frame_time = 1e30;
+    int chunk[2] = {first_chunk[0], first_chunk[1]};
+    while (chunk[1] > 0) {
+        for (int i = 0; i < chunk[1]; i++) {
+            if (process_frame(rank, chunk[0] + i, pool, ctx, writer) && first_frame_time == 1e30)
+                first_frame_time = MPI_Wtime() - ready_time;
+        }
 
-        MPI_Send(&frame_num, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+        MPI_Status status;
+        MPI_Send(&chunk[0], 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+        MPI_Recv(chunk, 2, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if (status.MPI_TAG == TAG_TERMINATE) break;
     }
+
+    char tag[32];
+    snprintf(tag, sizeof(tag), "WORKER %d", rank);
+    frame_writer_destroy(writer, tag);
+    edge_output_end();
+    frame_pool_log(pool, tag);
+    frame_pool_destroy(pool);
+    cpu_canny_destroy(ctx);
+    return first_frame_time;
 }
 
 int main(int argc, char** argv) {
@@ -108,22 +109,69 @@ int main(int argc, char** argv) {
     int rank, world_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    double start_time = MPI_Wtime();
 
-    int total_frames = count_frames("frames");
+    // Only rank 0 looks at the input and builds the frame list
+    TaskQueue queue = {0};
+    int total_frames = 0;
+    if (rank == 0) {
+        init_task_queue(&queue);
+        total_frames = queue.total_tasks;
+    }
+    MPI_Bcast(&total_frames, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    double start_time = 0.0;
+    // Every worker's first chunk (empty if there are fewer frames than workers)
+    int first_chunk[2];
+    int* first_chunks = NULL;
+    int active_workers = 0;
     if (rank == 0) {
-        log_info("MASTER: Starting with %d frames and %d workers", total_frames, world_size - 1);
-        start_time = MPI_Wtime();
+        first_chunks = calloc(2 * world_size, sizeof(int));
+        for (int w = 1; w < world_size; w++) {
+            first_chunks[2 * w + 1] = get_next_chunk(&queue, world_size - 1, &first_chunks[2 * w]);
+            if (first_chunks[2 * w + 1] > 0) active_workers++;
+        }
+    }
+    MPI_Scatter(first_chunks, 2, MPI_INT, first_chunk, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    free(first_chunks);
+
+    // Split each node's cores between the ranks placed on it
+    MPI_Comm node_comm;
+    int ranks_per_node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &ranks_per_node);
+    MPI_Comm_free(&node_comm);
+    int threads = cpu_filter_init_threads(ranks_per_node);
+    if (rank == 0) edge_output_begin("output/output_mpi/frame_%04d");
+
+    // Every rank is set up once it passes the barrier
+    MPI_Barrier(MPI_COMM_WORLD);
+    double ready_time = MPI_Wtime();
+    if (rank == 0) {
+        log_info("MASTER: Starting with %d frames and %d workers x %d threads (%s edge filter), ready after %.1f ms",
+                 total_frames, world_size - 1, threads,
+                 strcmp(env_str("EDGE_FILTER", "simple"), "canny") == 0 ? "Canny" : "simple",
+                 1000.0 * (MPI_Wtime() - start_time));
+    }
+
+    // Time to first frame: the earliest frame any worker computed, counted
+    // from the barrier on its own clock, plus rank 0's startup
+    double first_frame_time = 1e30, earliest;
+    if (rank == 0) {
+        master(&queue, active_workers, world_size);
+        free_task_queue(&queue);
+    } else {
+        first_frame_time = worker(rank, first_chunk, ready_time);
     }
+    MPI_Reduce(&first_frame_time, &earliest, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    if (rank == 0 && earliest < 1e30)
+        log_info("MASTER: Time to first frame: %.1f ms", 1000.0 * (ready_time - start_time + earliest));
 
+    // Workers return once their writers have flushed: the time covers every saved frame
+    MPI_Barrier(MPI_COMM_WORLD);
     if (rank == 0) {
-        master(total_frames, world_size);
         double end_time = MPI_Wtime();
         log_info("MASTER: All frames processed.");
         printf("Total MPI execution time: %.2f seconds\n", end_time - start_time);
-    } else {
-        worker(rank);
     }
 
     MPI_Finalize();
@@ -1,25 +1,39 @@
 #include <mpi.h>
 #include <stdio.h>
+#include <string.h>
+#include "frame_io.h"
 #include "utils.h"
 
-void run_master(int world_size);
-void run_worker_cuda(int rank, int world_size);
+void run_master(int world_size, double start_time);
+void run_worker_cuda(int rank, int world_size, int ranks_per_node);
 
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    // Workers load frames on helper threads; only the main thread calls MPI,
+    // except for the edge service thread of EDGE_EXCHANGE=peer
+    int peer = strcmp(env_str("EDGE_EXCHANGE", "relay"), "peer") == 0;
+    int provided;
+    MPI_Init_thread(&argc, &argv, peer ? MPI_THREAD_MULTIPLE : MPI_THREAD_FUNNELED, &provided);
 
     int rank, world_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    double start_time = MPI_Wtime();
 
     log_info("MPI initialized with %d processes.", world_size);
 
-    double start_time = MPI_Wtime();
+    // Ranks sharing this node (CPU workers split the cores between them)
+    MPI_Comm node_comm;
+    int ranks_per_node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_size(node_comm, &ranks_per_node);
+    MPI_Comm_free(&node_comm);
 
     if (rank == 0) {
-        run_master(world_size);
+        // Before run_master's startup barrier, so ahead of every worker's first save
+        edge_output_begin("output/output_mpi_cuda/frame_%04d");
+        run_master(world_size, start_time);
     } else {
-        run_worker_cuda(rank, world_size);
+        run_worker_cuda(rank, world_size, ranks_per_node);
     }
 
     double end_time = MPI_Wtime();
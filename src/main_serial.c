@@ -3,52 +3,47 @@
 #include <string.h>
 #include "frame_io.h"
 #include "utils.h"
-#include <time.h>
-
-#define MAX_FILENAME_LEN 256
-
-// Dummy CPU grayscale edge detection (for demo purposes)
-void simple_edge_filter(unsigned char* input, unsigned char* output, int w, int h, int c) {
-    for (int y = 1; y < h - 1; y++) {
-        for (int x = 1; x < w - 1; x++) {
-            int gx = input[(y * w + (x+1)) * c] - input[(y * w + (x-1)) * c];
-            int gy = input[((y+1) * w + x) * c] - input[((y-1) * w + x) * c];
-            int mag = abs(gx) + abs(gy);
-            output[y * w + x] = (mag > 100) ? 255 : 0;
-        }
-    }
+#include "cpu_filter.h"
+#include "pipeline.h"
+
+// Compute stage: run the selected CPU edge filter on one decoded frame
+// (arg is the Canny context, NULL for the simple filter)
+static void process_frame(frame_job* job, void* arg) {
+    cpu_canny_context* ctx = arg;
+    if (ctx)
+        cpu_canny_run(ctx, job->img, job->edges, job->width, job->height, job->channels, NULL);
+    else
+        simple_edge_filter(job->img, job->edges, job->width, job->height, job->channels);
 }
 
 int main() {
-    clock_t start = clock();
-    int total_frames = 3936;  // Adjust as needed
-    char input_filename[MAX_FILENAME_LEN];
-    char output_filename[MAX_FILENAME_LEN];
-
-    for (int i = 0; i < total_frames; i++) {
-        snprintf(input_filename, sizeof(input_filename), "frames/frame_%04d.jpg", i);
-        int w, h, c;
-        unsigned char* img = load_image(input_filename, &w, &h, &c);
-        if (!img) {
-            log_error("SERIAL: Failed to load %s", input_filename);
-            continue;
-        }
-
-        unsigned char* edges = malloc(w * h);
-        simple_edge_filter(img, edges, w, h, c);
-
-        snprintf(output_filename, sizeof(output_filename), "output/output_serial/frame_%04d.jpg", i);
-        save_image(output_filename, edges, w, h, 1);
-        log_info("SERIAL: Saved %s", output_filename);
-
-        free(img);
-        free(edges);
-    }
-
-    clock_t end = clock();
-
-    double elapsed = (double)(end - start) / CLOCKS_PER_SEC;
+    double start = wall_time();
+
+    // Open the Y4M streams first: with Y4M_OUTPUT=- this moves log output to stderr
+    pipeline_config cfg = {0};
+    if (pipeline_config_from_env(&cfg) != 0) return 1;
+
+    int total_frames = frame_input_pack_count();
+    if (total_frames < 0) total_frames = 3936;  // Adjust as needed
+
+    // EDGE_FILTER=canny runs the full CPU Canny pipeline instead of the demo filter
+    int use_canny = strcmp(env_str("EDGE_FILTER", "simple"), "canny") == 0;
+    int threads = cpu_filter_init_threads(0);
+    log_info("SERIAL: Using %s edge filter with %d thread(s)", use_canny ? "Canny" : "simple", threads);
+
+    cfg.total_frames = total_frames;
+    cfg.input_pattern = frame_input_pattern();
+    cfg.output_pattern = "output/output_serial/frame_%04d";
+    cfg.tag = "SERIAL";
+    cfg.process = process_frame;
+    cfg.process_arg = use_canny ? cpu_canny_create(0, 0) : NULL;
+
+    int status = run_frame_pipeline(&cfg) < 0 ? 1 : 0;
+    if (pipeline_close_streams(&cfg) != 0) status = 1;
+    cpu_canny_destroy(cfg.process_arg);
+
+    double elapsed = wall_time() - start;
     printf("Serial processing took %.2f seconds\n", elapsed);
 
-    return 0;
+    return status;
 }
@@ -3,7 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <unistd.h>
+#include <limits.h>
 #include "utils.h"
 #include "task_queue.h"
 
@@ -14,163 +14,625 @@
 #define TAG_EDGE_REQUEST     5
 #define TAG_EDGE_DATA        6
 #define TAG_EDGE_DIMS        7
-#define MAX_FRAMES           10000  // Adjust based on your needs
 
+// Edges are kept in the workers' wire encoding (see edge_codec.h) and
+// relayed as received; the master never decodes them
 typedef struct {
     unsigned char* edges;
+    int frame;        // -1 while the slot is empty
     int width;
     int height;
-    int available;
+    int size;         // encoded bytes
 } FrameEdge;
 
-void run_master(int world_size) {
+// Relayed edges, in an open-addressed table keyed by frame number. Workers
+// send only a chunk's last frame n, and its entry lives until nobody can
+// fetch it any more: the worker given frame n + 1 fetched it, already had it
+// (the next chunk went to the same rank), moved past n + 1 without it, or
+// terminated. Nothing is evicted before that; once the next edges would take
+// the store past limit bytes, they are left unreceived and their producer
+// waits (see serve_deferred), so memory follows the frames in flight, not
+// the job.
+// A worker asking for edges that are not in yet waits in its receive until
+// they arrive; they are handed straight over without being stored.
+typedef struct {
+    FrameEdge* slots;
+    int capacity, shift;    // power-of-two table, Fibonacci hashed
+    size_t limit;           // encoded bytes held before producers wait
+    int held, peak_held;
+    size_t bytes, peak_bytes;
+    int fetched, unneeded, passed, waits;
+    int* reached;           // per worker: it is past every frame before this
+    int* waiting;           // per worker: the frame it waits for edges of, or -1
+    int workers;
+} EdgeStore;
+
+static void edge_store_alloc(EdgeStore* store, int capacity, int shift) {
+    store->capacity = capacity;
+    store->shift = shift;
+    store->slots = malloc(capacity * sizeof(FrameEdge));
+    for (int i = 0; i < capacity; i++) store->slots[i] = (FrameEdge){NULL, -1, 0, 0, 0};
+}
+
+static void edge_store_init(EdgeStore* store, size_t limit, int world_size) {
+    *store = (EdgeStore){0};
+    store->limit = limit;
+    store->reached = calloc(world_size, sizeof(int));
+    store->waiting = malloc(world_size * sizeof(int));
+    for (int i = 0; i < world_size; i++) store->waiting[i] = -1;
+    store->workers = world_size;
+    edge_store_alloc(store, 16, 28);
+}
+
+static int edge_store_home(const EdgeStore* store, int frame) {
+    return (int)(((unsigned)frame * 2654435769u) >> store->shift);
+}
+
+static FrameEdge* edge_store_find(EdgeStore* store, int frame) {
+    if (frame < 0) return NULL;
+    int mask = store->capacity - 1;
+    for (int i = edge_store_home(store, frame);; i = (i + 1) & mask) {
+        FrameEdge* slot = &store->slots[i];
+        if (slot->frame == frame) return slot;
+        if (slot->frame < 0) return NULL;
+    }
+}
+
+static void edge_store_insert(EdgeStore* store, FrameEdge entry) {
+    int mask = store->capacity - 1;
+    int i = edge_store_home(store, entry.frame);
+    while (store->slots[i].frame >= 0) i = (i + 1) & mask;
+    store->slots[i] = entry;
+}
+
+// Free slot's entry, shifting the entries probed past it back so lookups
+// never need tombstones
+static void edge_store_remove(EdgeStore* store, FrameEdge* slot) {
+    free(slot->edges);
+    store->held--;
+    store->bytes -= slot->size;
+
+    int mask = store->capacity - 1;
+    int hole = (int)(slot - store->slots);
+    for (int i = (hole + 1) & mask; store->slots[i].frame >= 0; i = (i + 1) & mask) {
+        int home = edge_store_home(store, store->slots[i].frame);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            store->slots[hole] = store->slots[i];
+            hole = i;
+        }
+    }
+    store->slots[hole] = (FrameEdge){NULL, -1, 0, 0, 0};
+}
+
+// Take ownership of edges, the wire encoding of frame
+static void edge_store_put(EdgeStore* store, int frame, int width, int height, unsigned char* edges, int size) {
+    FrameEdge* old = edge_store_find(store, frame);
+    if (old) edge_store_remove(store, old);
+
+    // Keep the table at most half full
+    if (2 * (store->held + 1) > store->capacity) {
+        FrameEdge* slots = store->slots;
+        int capacity = store->capacity;
+        edge_store_alloc(store, 2 * capacity, store->shift - 1);
+        for (int i = 0; i < capacity; i++) {
+            if (slots[i].frame >= 0) edge_store_insert(store, slots[i]);
+        }
+        free(slots);
+    }
+
+    edge_store_insert(store, (FrameEdge){edges, frame, width, height, size});
+    store->held++;
+    store->bytes += size;
+    if (store->held > store->peak_held) store->peak_held = store->held;
+    if (store->bytes > store->peak_bytes) store->peak_bytes = store->bytes;
+}
+
+// One receive per worker and message kind stays posted, so the master sleeps
+// in MPI_Waitsome until a message lands instead of polling with MPI_Iprobe.
+// Request (w - 1) * INBOX_KINDS + kind belongs to worker w.
+enum { INBOX_EDGE_DIMS, INBOX_EDGE_REQUEST, INBOX_TASK_REQUEST, INBOX_RESULT, INBOX_TERMINATE, INBOX_KINDS };
+
+typedef struct {
+    int dims[3];
+    int frame;              // whose edges dims announce, received with them
+    int edge_request;
+    int task_request;
+    char result[512];
+    int ack;
+} WorkerInbox;
+
+// Chunks whose first frame still has to fetch the relayed edges of the frame
+// before it from another worker, keyed by that first frame: the rank given
+// frame n + 1 is the one that can fetch the edges of frame n. An entry goes
+// once its worker's request is answered, so the log holds the chunks in
+// flight, not the job. Chunks go out in frame order, so the last one handed
+// out tells who holds the frame before the next (with EDGE_EXCHANGE=peer the
+// chunk goes out with that rank, which the worker asks for those edges
+// directly) and which frames are handed out already.
+typedef struct {
+    int first;        // -1 while the slot is empty
+    int count;
+    int rank;
+} ChunkRecord;
+
+typedef struct {
+    ChunkRecord* slots;
+    int capacity, shift;    // power-of-two table, Fibonacci hashed like EdgeStore
+    int held, peak_held;
+    ChunkRecord last;       // the chunk handed out most recently
+    int relay;              // chunks fetch their previous edges via the master
+} ChunkLog;
+
+static void chunk_log_alloc(ChunkLog* chunks, int capacity, int shift) {
+    chunks->capacity = capacity;
+    chunks->shift = shift;
+    chunks->slots = malloc(capacity * sizeof(ChunkRecord));
+    for (int i = 0; i < capacity; i++) chunks->slots[i] = (ChunkRecord){-1, 0, 0};
+}
+
+static void chunk_log_init(ChunkLog* chunks, int relay) {
+    *chunks = (ChunkLog){0};
+    chunks->last = (ChunkRecord){-1, 0, -1};
+    chunks->relay = relay;
+    chunk_log_alloc(chunks, 16, 28);
+}
+
+static int chunk_log_home(const ChunkLog* chunks, int first) {
+    return (int)(((unsigned)first * 2654435769u) >> chunks->shift);
+}
+
+// The waiting chunk that starts at first, or NULL
+static ChunkRecord* chunk_log_find(ChunkLog* chunks, int first) {
+    if (first < 0) return NULL;
+    int mask = chunks->capacity - 1;
+    for (int i = chunk_log_home(chunks, first);; i = (i + 1) & mask) {
+        ChunkRecord* slot = &chunks->slots[i];
+        if (slot->first == first) return slot;
+        if (slot->first < 0) return NULL;
+    }
+}
+
+static void chunk_log_insert(ChunkLog* chunks, ChunkRecord record) {
+    int mask = chunks->capacity - 1;
+    int i = chunk_log_home(chunks, record.first);
+    while (chunks->slots[i].first >= 0) i = (i + 1) & mask;
+    chunks->slots[i] = record;
+}
+
+// Drop slot's chunk once nothing is relayed to it any more, shifting back
+// the entries probed past it (see edge_store_remove)
+static void chunk_log_drop(ChunkLog* chunks, ChunkRecord* slot) {
+    chunks->held--;
+    int mask = chunks->capacity - 1;
+    int hole = (int)(slot - chunks->slots);
+    for (int i = (hole + 1) & mask; chunks->slots[i].first >= 0; i = (i + 1) & mask) {
+        int home = chunk_log_home(chunks, chunks->slots[i].first);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            chunks->slots[hole] = chunks->slots[i];
+            hole = i;
+        }
+    }
+    chunks->slots[hole] = (ChunkRecord){-1, 0, 0};
+}
+
+static void record_chunk(ChunkLog* chunks, ChunkRecord record) {
+    if (2 * (chunks->held + 1) > chunks->capacity) {
+        ChunkRecord* slots = chunks->slots;
+        int capacity = chunks->capacity;
+        chunk_log_alloc(chunks, 2 * capacity, chunks->shift - 1);
+        for (int i = 0; i < capacity; i++) {
+            if (slots[i].first >= 0) chunk_log_insert(chunks, slots[i]);
+        }
+        free(slots);
+    }
+    chunk_log_insert(chunks, record);
+    chunks->held++;
+    if (chunks->held > chunks->peak_held) chunks->peak_held = chunks->held;
+}
+
+// Whether frame has been handed out (or skipped over, if not in the job)
+static bool chunk_log_passed(const ChunkLog* chunks, int frame) {
+    return frame < chunks->last.first + chunks->last.count;
+}
+
+// Rank that can fetch the relayed edges of frame, or -1 if none can yet
+static int chunk_consumer(ChunkLog* chunks, int frame) {
+    ChunkRecord* next = chunk_log_find(chunks, frame + 1);
+    return next ? next->rank : -1;
+}
+
+// Fill chunk {first, count, prev_owner} with the next chunk for worker and
+// return the rank given frame first - 1, or -1 if nobody was
+static int next_chunk(TaskQueue* queue, ChunkLog* chunks, int peer, int workers, int worker, int* chunk) {
+    chunk[1] = get_next_chunk(queue, workers, &chunk[0]);
+    chunk[2] = -1;
+    if (chunk[1] <= 0) return -1;
+
+    // Frame first - 1 is in the last chunk unless there is a gap before first
+    int prev = chunk[0] == chunks->last.first + chunks->last.count ? chunks->last.rank : -1;
+    if (peer && chunk[0] > 0) chunk[2] = prev;
+    chunks->last = (ChunkRecord){chunk[0], chunk[1], worker};
+    if (chunks->relay && prev > 0 && prev != worker) record_chunk(chunks, chunks->last);
+    return prev;
+}
+
+static void post_receive(WorkerInbox* inbox, MPI_Request* request, int worker, int kind) {
+    switch (kind) {
+    case INBOX_EDGE_DIMS:
+        MPI_Irecv(inbox->dims, 3, MPI_INT, worker, TAG_EDGE_DIMS, MPI_COMM_WORLD, request);
+        break;
+    case INBOX_EDGE_REQUEST:
+        MPI_Irecv(&inbox->edge_request, 1, MPI_INT, worker, TAG_EDGE_REQUEST, MPI_COMM_WORLD, request);
+        break;
+    case INBOX_TASK_REQUEST:
+        MPI_Irecv(&inbox->task_request, 1, MPI_INT, worker, TAG_TASK_REQUEST, MPI_COMM_WORLD, request);
+        break;
+    case INBOX_RESULT:
+        MPI_Irecv(inbox->result, sizeof(inbox->result), MPI_CHAR, worker, TAG_RESULT, MPI_COMM_WORLD, request);
+        break;
+    case INBOX_TERMINATE:
+        MPI_Irecv(&inbox->ack, 1, MPI_INT, worker, TAG_TERMINATE, MPI_COMM_WORLD, request);
+        break;
+    }
+}
+
+// Answer worker's edge request with entry, or with no edges when there is
+// none or its frame failed (width 0)
+static void send_edges(int worker, const FrameEdge* entry) {
+    int dims[3] = {0, 0, 0};
+    if (entry && entry->width > 0) {
+        dims[0] = entry->width;
+        dims[1] = entry->height;
+        dims[2] = entry->size;
+    }
+    MPI_Send(dims, 3, MPI_INT, worker, TAG_EDGE_DIMS, MPI_COMM_WORLD);
+    if (dims[0] > 0) MPI_Send(entry->edges, dims[2], MPI_UNSIGNED_CHAR, worker, TAG_EDGE_DATA, MPI_COMM_WORLD);
+}
+
+// The worker blocked asking for frame's edges, or -1
+static int edge_store_waiter(const EdgeStore* store, int frame) {
+    for (int w = 1; w < store->workers; w++) {
+        if (store->waiting[w] == frame) return w;
+    }
+    return -1;
+}
+
+// Whether an entry in store waits for worker to fetch it
+static bool edge_store_awaits(const EdgeStore* store, ChunkLog* chunks, int worker) {
+    for (int i = 0; i < store->capacity; i++) {
+        int frame = store->slots[i].frame;
+        if (frame >= 0 && chunk_consumer(chunks, frame) == worker) return true;
+    }
+    return false;
+}
+
+// Note that worker is past every frame before frame and free the entries it
+// was to fetch for them: it works through its frames in order, so it has
+// gone past those without asking
+static void edge_store_pass(EdgeStore* store, ChunkLog* chunks, int worker, int frame) {
+    if (frame > store->reached[worker]) store->reached[worker] = frame;
+    if (store->held == 0) return;
+    for (int i = 0; i < store->capacity;) {
+        FrameEdge* slot = &store->slots[i];
+        ChunkRecord* next = slot->frame >= 0 && slot->frame < frame ? chunk_log_find(chunks, slot->frame + 1) : NULL;
+        if (next && next->rank == worker) {
+            chunk_log_drop(chunks, next);
+            edge_store_remove(store, slot);   // refills slot i, so look again
+            store->passed++;
+        } else {
+            i++;
+        }
+    }
+}
+
+// Receive the edges worker announced in inbox and post its next dims
+// receive. A width of 0 says the frame failed, so whoever asks gets no
+// edges. They go straight to a worker already waiting for them, else they
+// are kept only if some other worker can still fetch them: frame n + 1 is
+// in the job and either not handed out yet, or out to a worker that has yet
+// to fetch them and has not gone past it (or ended) while these were on
+// their way.
+static void accept_edges(EdgeStore* store, ChunkLog* chunks, const TaskQueue* queue,
+                         WorkerInbox* inbox, MPI_Request* request, int worker) {
+    int* dims = inbox->dims;
+    int frame_num = inbox->frame;
+    MPI_Status status;
+
+    // Receive edge data
+    unsigned char* edges = malloc(dims[2] > 0 ? dims[2] : 1);
+    MPI_Recv(edges, dims[2], MPI_UNSIGNED_CHAR, worker, TAG_EDGE_DATA, MPI_COMM_WORLD, &status);
+    if (dims[0] == 0) log_error("MASTER: Worker %d failed frame %d, no edges for the next chunk", worker, frame_num);
+
+    ChunkRecord* next = frame_num >= 0 ? chunk_log_find(chunks, frame_num + 1) : NULL;
+    int waiter = edge_store_waiter(store, frame_num);
+    if (waiter > 0) {
+        FrameEdge entry = {edges, frame_num, dims[0], dims[1], dims[2]};
+        send_edges(waiter, &entry);
+        free(edges);
+        store->waiting[waiter] = -1;
+        if (next) chunk_log_drop(chunks, next);
+        if (dims[0] > 0) store->fetched++;
+        log_info("MASTER: Passed edges for frame %d on to worker %d", frame_num, waiter);
+    } else if (frame_num < 0 || !task_queue_contains(queue, frame_num + 1) ||
+               (!next && chunk_log_passed(chunks, frame_num + 1))) {
+        free(edges);
+        store->unneeded++;
+    } else if (next && frame_num < store->reached[next->rank]) {
+        chunk_log_drop(chunks, next);
+        free(edges);
+        store->passed++;
+    } else {
+        edge_store_put(store, frame_num, dims[0], dims[1], edges, dims[2]);
+        log_info("MASTER: Stored edges for frame %d (%dx%d, %d bytes)", frame_num, dims[0], dims[1], dims[2]);
+    }
+    edge_store_pass(store, chunks, worker, frame_num);
+    post_receive(inbox, request, worker, INBOX_EDGE_DIMS);
+}
+
+// Take the edges held back while the store was full, as far as it has room.
+// A waiting producer is let in past the limit when an entry waits for it to
+// fetch: blocked in its send it never would, and the store would stay full.
+// So is one whose edges a worker is blocked asking for, a failed frame's
+// notice, which holds no data, and the first edges into an empty store.
+// Should every worker still running be waiting all the same, the lowest
+// rank is let in, since nothing else would free an entry.
+static void serve_deferred(EdgeStore* store, ChunkLog* chunks, const TaskQueue* queue, WorkerInbox* inboxes,
+                           MPI_Request* requests, bool* deferred, const bool* terminated, int world_size) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        int stuck = -1;
+        for (int w = 1; w < world_size; w++) {
+            if (!deferred[w]) continue;
+            if (store->held > 0 && store->bytes + inboxes[w].dims[2] > store->limit && inboxes[w].dims[0] > 0 &&
+                edge_store_waiter(store, inboxes[w].frame) < 0 && !edge_store_awaits(store, chunks, w)) {
+                if (stuck < 0) stuck = w;
+                continue;
+            }
+            deferred[w] = false;
+            accept_edges(store, chunks, queue, &inboxes[w], &requests[(w - 1) * INBOX_KINDS + INBOX_EDGE_DIMS], w);
+            progress = true;
+        }
+        if (progress || stuck < 0) continue;
+        for (int w = 1; w < world_size && stuck > 0; w++) {
+            if (!terminated[w] && !deferred[w] && store->waiting[w] < 0) stuck = -1;
+        }
+        if (stuck > 0) {
+            deferred[stuck] = false;
+            accept_edges(store, chunks, queue, &inboxes[stuck], &requests[(stuck - 1) * INBOX_KINDS + INBOX_EDGE_DIMS], stuck);
+            progress = true;
+        }
+    }
+}
+
+void run_master(int world_size, double start_time) {
     TaskQueue queue;
     init_task_queue(&queue);
-    log_info("MASTER: Initialized queue with %d frames", queue.total_tasks);
+    log_info("MASTER: Initialized queue with %d frames in %d run(s)", queue.total_tasks, queue.num_ranges);
 
-    bool terminated[world_size];
-    for (int i = 0; i < world_size; i++) terminated[i] = false;
+    // A worker may still be finishing prefetched frames after it was told
+    // there is no more work, so it only counts as done once it acks
+    bool terminate_sent[world_size], terminated[world_size];
+    for (int i = 0; i < world_size; i++) terminate_sent[i] = terminated[i] = false;
 
-    // Edge storage for temporal linking
-    FrameEdge edge_storage[MAX_FRAMES] = {0};
+    // Edge storage for temporal linking. It holds about one entry per chunk
+    // in flight: the one each worker runs, up to WORKER_PREFETCH ahead and
+    // the one it has asked for. EDGE_STORE_MAX=<KB> caps the encoded bytes
+    // held (default 64 MB); past that, producers wait.
+    int store_max = env_int("EDGE_STORE_MAX", 64 * 1024);
+    EdgeStore edge_store;
+    edge_store_init(&edge_store, (size_t)(store_max > 0 ? store_max : 1) * 1024, world_size);
+    bool deferred[world_size];   // edges left unreceived while the store is full
+    for (int i = 0; i < world_size; i++) deferred[i] = false;
     int tasks_sent = 0;
+    int chunks_sent = 0;
     int terminated_workers = 0;
 
-    // Warm-up period
-    for (int i = 0; i < 3; i++) {
-        log_info("MASTER: Warm-up %d/3", i+1);
-        sleep(1);
+    // TASK_SCHEDULE=segments: the frames are cut into SEGMENTS_PER_WORKER
+    // (default 1) contiguous segments per worker. Workers recompute the
+    // halo frame before each segment themselves, so no edges pass through here.
+    int segments = strcmp(env_str("TASK_SCHEDULE", "guided"), "segments") == 0;
+    if (segments) {
+        int per_worker = env_int("SEGMENTS_PER_WORKER", 1);
+        int parts = (world_size - 1) * (per_worker > 0 ? per_worker : 1);
+        int length = (queue.total_tasks + parts - 1) / parts;
+        queue.min_chunk = queue.max_chunk = length > 0 ? length : 1;
+    }
+
+    // EDGE_EXCHANGE=peer: workers fetch a chunk's previous edges straight
+    // from the worker that computed them, so no edge data passes through
+    // here. Their service thread calls MPI concurrently with the main thread.
+    int peer = 0;
+    if (!segments && strcmp(env_str("EDGE_EXCHANGE", "relay"), "peer") == 0) {
+        int level;
+        MPI_Query_thread(&level);
+        peer = level >= MPI_THREAD_MULTIPLE;
+        if (!peer) log_error("MASTER: EDGE_EXCHANGE=peer needs MPI_THREAD_MULTIPLE; relaying edges instead");
+    }
+    ChunkLog chunk_log;
+    chunk_log_init(&chunk_log, !segments && !peer);
+
+    // Work goes out in chunks {first frame, count, prev_owner} of consecutive
+    // frames; a count of 0 means there is no work left. prev_owner is the
+    // rank holding the edges of frame first - 1 in peer mode, else -1.
+    // Startup handshake (matched in run_worker_cuda): the frame count with the
+    // schedule and edge exchange, and each worker's first chunk go out in two collectives, then
+    // everyone meets at a barrier. A worker given an empty chunk has nothing
+    // to do and only acks.
+    int startup[3] = {queue.total_tasks, segments, peer};
+    int* first_chunks = calloc(3 * world_size, sizeof(int));
+    for (int w = 1; w < world_size; w++) {
+        int* chunk = &first_chunks[3 * w];
+        next_chunk(&queue, &chunk_log, peer, world_size - 1, w, chunk);
+        if (chunk[1] > 0) chunks_sent++;
+        tasks_sent += chunk[1];
+        terminate_sent[w] = chunk[1] == 0;
+    }
+    int own_chunk[3];
+    MPI_Bcast(startup, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Scatter(first_chunks, 3, MPI_INT, own_chunk, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+    free(first_chunks);
+    double ready = MPI_Wtime() - start_time;
+    log_info("MASTER: %d workers started with their first %s after %.1f ms (edges %s)", chunks_sent,
+             segments ? "segment" : "chunk", 1000.0 * ready,
+             segments ? "recomputed" : peer ? "exchanged between workers" : "relayed");
+
+    int num_requests = (world_size - 1) * INBOX_KINDS;
+    WorkerInbox* inboxes = calloc(world_size, sizeof(WorkerInbox));
+    MPI_Request* requests = malloc(num_requests * sizeof(MPI_Request));
+    int* completed = malloc(num_requests * sizeof(int));
+    MPI_Status* statuses = malloc(num_requests * sizeof(MPI_Status));
+    for (int i = 0; i < num_requests; i++) {
+        post_receive(&inboxes[i / INBOX_KINDS + 1], &requests[i], i / INBOX_KINDS + 1, i % INBOX_KINDS);
     }
 
     while (terminated_workers < world_size - 1) {
-        MPI_Status status;
-        int flag;
-        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
-
-        if (flag) {
-            // Handle edge data requests
-            if (status.MPI_TAG == TAG_EDGE_REQUEST) {
-                int requested_frame;
-                MPI_Recv(&requested_frame, 1, MPI_INT, status.MPI_SOURCE, 
-                        TAG_EDGE_REQUEST, MPI_COMM_WORLD, &status);
-                
-                log_info("MASTER: Worker %d requested edges for frame %d", 
-                        status.MPI_SOURCE, requested_frame);
-
-                if (requested_frame >= 0 && requested_frame < MAX_FRAMES && 
-                    edge_storage[requested_frame].available) {
-                    // Send edge dimensions first
-                    int dims[2] = {edge_storage[requested_frame].width, 
-                                  edge_storage[requested_frame].height};
-                    MPI_Send(dims, 2, MPI_INT, status.MPI_SOURCE, 
-                            TAG_EDGE_DIMS, MPI_COMM_WORLD);
-                    
-                    // Send edge data
-                    MPI_Send(edge_storage[requested_frame].edges, 
-                            dims[0] * dims[1], MPI_UNSIGNED_CHAR,
-                            status.MPI_SOURCE, TAG_EDGE_DATA, MPI_COMM_WORLD);
-                    
-                    log_info("MASTER: Sent edges for frame %d to worker %d", 
-                            requested_frame, status.MPI_SOURCE);
-                } else {
-                    log_error("MASTER: No edges available for frame %d", requested_frame);
-                    int dims[2] = {0, 0};
-                    MPI_Send(dims, 2, MPI_INT, status.MPI_SOURCE, 
-                            TAG_EDGE_DIMS, MPI_COMM_WORLD);
+        int num_completed;
+        MPI_Waitsome(num_requests, requests, &num_completed, completed, statuses);
+        if (num_completed == MPI_UNDEFINED) break;
+
+        // Acks last: a worker's final edges may complete in the same batch
+        for (int pass = 0; pass < 2; pass++) {
+            for (int c = 0; c < num_completed; c++) {
+                int worker_rank = completed[c] / INBOX_KINDS + 1;
+                int kind = completed[c] % INBOX_KINDS;
+                if ((kind == INBOX_TERMINATE) != (pass == 1)) continue;
+                WorkerInbox* inbox = &inboxes[worker_rank];
+
+                // Handle edge data requests
+                if (kind == INBOX_EDGE_REQUEST) {
+                    int requested_frame = inbox->edge_request;
+                    log_info("MASTER: Worker %d requested edges for frame %d", 
+                            worker_rank, requested_frame);
+
+                    // Anything older that was kept for this worker is stale
+                    edge_store_pass(&edge_store, &chunk_log, worker_rank, requested_frame);
+                    FrameEdge* stored = edge_store_find(&edge_store, requested_frame);
+                    ChunkRecord* next = chunk_log_find(&chunk_log, requested_frame + 1);
+                    if (stored) {
+                        // Edge dimensions and encoded size first, then the data
+                        send_edges(worker_rank, stored);
+                        log_info("MASTER: Sent edges for frame %d to worker %d", 
+                                requested_frame, worker_rank);
+
+                        // Only the next frame links against it
+                        if (stored->width > 0) edge_store.fetched++;
+                        edge_store_remove(&edge_store, stored);
+                        if (next) chunk_log_drop(&chunk_log, next);
+                    } else if (!next || next->rank != worker_rank) {
+                        // Not in the job, or this worker's own frame that it
+                        // failed: nobody will send these
+                        log_error("MASTER: No edges available for frame %d", requested_frame);
+                        send_edges(worker_rank, NULL);
+                    } else {
+                        // Another worker was given it before this chunk went
+                        // out, so they come; answered in accept_edges
+                        edge_store.waiting[worker_rank] = requested_frame;
+                        log_info("MASTER: Worker %d waits for edges of frame %d", worker_rank, requested_frame);
+                    }
                 }
-            }
-            // Handle task requests
-            else if (status.MPI_TAG == TAG_TASK_REQUEST) {
-                int dummy;
-                MPI_Recv(&dummy, 1, MPI_INT, status.MPI_SOURCE, TAG_TASK_REQUEST, MPI_COMM_WORLD, &status);
-                int worker_rank = status.MPI_SOURCE;
-
-                if (queue.current_index < queue.total_tasks) {
-                    const char* task = get_next_task(&queue);
-                    MPI_Send(task, MAX_FILENAME_LEN, MPI_CHAR, worker_rank, 
-                            TAG_TASK_SEND, MPI_COMM_WORLD);
-                    tasks_sent++;
-                    log_info("MASTER: Sent frame %d/%d to worker %d", 
-                        queue.current_index - 1, queue.total_tasks, worker_rank);
-                } else {
-                    if (!terminated[worker_rank]) {
-                        MPI_Send(NULL, 0, MPI_CHAR, worker_rank, TAG_TERMINATE, MPI_COMM_WORLD);
-                        terminated[worker_rank] = true;
-                        terminated_workers++;
-                        log_info("MASTER: Sent TERMINATE to worker %d (%d/%d terminated)", 
-                                 worker_rank, terminated_workers, world_size - 1);
+                // Handle task requests
+                else if (kind == INBOX_TASK_REQUEST) {
+                    int chunk[3];
+                    int prev = next_chunk(&queue, &chunk_log, peer, world_size - 1, worker_rank, chunk);
+                    if (chunk[1] > 0) {
+                        MPI_Send(chunk, 3, MPI_INT, worker_rank, TAG_TASK_SEND, MPI_COMM_WORLD);
+                        tasks_sent += chunk[1];
+                        chunks_sent++;
+                        log_info("MASTER: Sent frames %d-%d (%d/%d) to worker %d", 
+                            chunk[0], chunk[0] + chunk[1] - 1, queue.current_index, queue.total_tasks, worker_rank);
+
+                        // The worker goes on from its own previous frame
+                        FrameEdge* own = prev == worker_rank ? edge_store_find(&edge_store, chunk[0] - 1) : NULL;
+                        if (own) {
+                            edge_store_remove(&edge_store, own);
+                            edge_store.unneeded++;
+                        }
+                    } else {
+                        // Empty chunk: no work left (sent on TAG_TASK_SEND so it
+                        // matches the worker's pending task receive)
+                        if (!terminate_sent[worker_rank]) {
+                            int no_task[3] = {-1, 0, -1};
+                            MPI_Send(no_task, 3, MPI_INT, worker_rank, TAG_TASK_SEND, MPI_COMM_WORLD);
+                            terminate_sent[worker_rank] = true;
+                            log_info("MASTER: Sent TERMINATE to worker %d", worker_rank);
+                        }
                     }
                 }
-            }
-            // Handle edge data storage
-            else if (status.MPI_TAG == TAG_EDGE_DIMS) {
-                int dims[2];
-                MPI_Recv(dims, 2, MPI_INT, status.MPI_SOURCE, 
-                        TAG_EDGE_DIMS, MPI_COMM_WORLD, &status);
-                
-                int frame_num;
-                char frame_path[MAX_FILENAME_LEN];
-                MPI_Recv(frame_path, MAX_FILENAME_LEN, MPI_CHAR, status.MPI_SOURCE,
-                    TAG_EDGE_DIMS, MPI_COMM_WORLD, &status);
-                
-                if (sscanf(frame_path, "frames/frame_%d.jpg", &frame_num) != 1) {
-                    log_error("MASTER: Failed to parse frame number from '%s'", frame_path);
-                    continue;
+                // Handle edge data storage: the frame number follows on the
+                // same tag, the data is received once the store has room
+                // (see serve_deferred)
+                else if (kind == INBOX_EDGE_DIMS) {
+                    MPI_Recv(&inbox->frame, 1, MPI_INT, worker_rank, TAG_EDGE_DIMS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    deferred[worker_rank] = true;
+                    serve_deferred(&edge_store, &chunk_log, &queue, inboxes, requests, deferred, terminated, world_size);
+                    if (deferred[worker_rank]) {
+                        edge_store.waits++;
+                        log_info("MASTER: Edge store full, worker %d waits", worker_rank);
+                    }
+                    continue;   // the receive is posted again once accepted
                 }
-                
-                if (frame_num >= 0 && frame_num < MAX_FRAMES) {
-                    // Free previous data if exists
-                    if (edge_storage[frame_num].edges) {
-                        free(edge_storage[frame_num].edges);
+                // Handle termination acknowledgments
+                else if (kind == INBOX_TERMINATE) {
+                    log_info("MASTER: Received TERMINATE ack from worker %d", 
+                            worker_rank);
+                    if (!terminated[worker_rank]) {
+                        terminated[worker_rank] = true;
+                        terminated_workers++;
+                        log_info("MASTER: Now %d/%d workers terminated", terminated_workers, world_size - 1);
+                        edge_store_pass(&edge_store, &chunk_log, worker_rank, INT_MAX);
                     }
-                    
-                    edge_storage[frame_num].width = dims[0];
-                    edge_storage[frame_num].height = dims[1];
-                    edge_storage[frame_num].edges = malloc(dims[0] * dims[1]);
-                    edge_storage[frame_num].available = 0;
-                    
-                    // Receive edge data
-                    MPI_Recv(edge_storage[frame_num].edges, dims[0] * dims[1],
-                            MPI_UNSIGNED_CHAR, status.MPI_SOURCE, TAG_EDGE_DATA,
-                            MPI_COMM_WORLD, &status);
-                    
-                    edge_storage[frame_num].available = 1;
-                    log_info("MASTER: Stored edges for frame %d (%dx%d)", 
-                            frame_num, dims[0], dims[1]);
+                    continue;   // nothing more is expected on this tag
                 }
-            }
-            // Handle termination acknowledgments
-            else if (status.MPI_TAG == TAG_TERMINATE) {
-                int ack;
-                MPI_Recv(&ack, 1, MPI_INT, status.MPI_SOURCE, 
-                        TAG_TERMINATE, MPI_COMM_WORLD, &status);
-                log_info("MASTER: Received TERMINATE ack from worker %d", 
-                        status.MPI_SOURCE);
-                if (!terminated[status.MPI_SOURCE]) {
-                    terminated[status.MPI_SOURCE] = true;
-                    terminated_workers++;
-                    log_info("MASTER: Now %d/%d workers terminated", terminated_workers, world_size - 1);
+                // Handle results
+                else if (kind == INBOX_RESULT) {
+                    log_info("MASTER: Received result: %s", inbox->result);
                 }
+                post_receive(inbox, &requests[completed[c]], worker_rank, kind);
             }
-            // Handle results
-            else if (status.MPI_TAG == TAG_RESULT) {
-                char result[512];
-                MPI_Recv(result, 512, MPI_CHAR, MPI_ANY_SOURCE, 
-                        TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                log_info("MASTER: Received result: %s", result);
-            }
-        } else {
-            usleep(1000); // Prevent busy waiting
         }
+
+        // Entries freed above may make room for a waiting producer
+        serve_deferred(&edge_store, &chunk_log, &queue, inboxes, requests, deferred, terminated, world_size);
     }
 
+    // Receives that were never matched
+    for (int i = 0; i < num_requests; i++) {
+        if (requests[i] == MPI_REQUEST_NULL) continue;
+        MPI_Cancel(&requests[i]);
+        MPI_Wait(&requests[i], MPI_STATUS_IGNORE);
+    }
+    free(statuses);
+    free(completed);
+    free(requests);
+    free(inboxes);
+    free(chunk_log.slots);
+
+    // Peer mode: every worker is done asking its peers for edges once all
+    // are past this barrier, and stops its service thread
+    if (peer) MPI_Barrier(MPI_COMM_WORLD);
+
     // Cleanup
-    for (int i = 0; i < MAX_FRAMES; i++) {
-        if (edge_storage[i].edges) {
-            free(edge_storage[i].edges);
-        }
+    if (edge_store.peak_held > 0 || edge_store.unneeded > 0 || edge_store.fetched > 0) {
+        log_info("MASTER: Edge store (max %zu KB): peak %.1f KB in %d frame(s) | %d fetched, %d not needed, "
+                 "%d passed over, %d producer wait(s), %d left | %d chunk(s) awaiting edges at most",
+                 edge_store.limit / 1024, edge_store.peak_bytes / 1024.0, edge_store.peak_held, edge_store.fetched,
+                 edge_store.unneeded, edge_store.passed, edge_store.waits, edge_store.held, chunk_log.peak_held);
     }
-    
+    for (int i = 0; i < edge_store.capacity; i++) free(edge_store.slots[i].edges);
+    free(edge_store.slots);
+    free(edge_store.reached);
+    free(edge_store.waiting);
+
     log_info("MASTER: All workers terminated. Processed %d/%d frames.", 
             tasks_sent, queue.total_tasks);
-}
\ No newline at end of file
+    log_info("MASTER: %d chunks (%.1f frames per task request), chunk size %d..%d", 
+            chunks_sent, chunks_sent ? (double)tasks_sent / chunks_sent : 0.0, queue.min_chunk, queue.max_chunk);
+
+    // Each worker's first finished frame, counted from the startup barrier
+    double no_frame = 1e30, first_frame;
+    MPI_Reduce(&no_frame, &first_frame, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    if (first_frame < no_frame) log_info("MASTER: Time to first frame: %.1f ms", 1000.0 * (ready + first_frame));
+    free_task_queue(&queue);
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "frame_io.h"
+#include "frame_pack.h"
+#include "utils.h"
+
+// Convert numbered images (default frames/frame_%04d.jpg, from index 0 until
+// the first missing file) into one frame pack:
+//   pack_frames [output.pack] [input pattern]
+// Then run any driver with FRAME_PACK=output.pack.
+int main(int argc, char** argv) {
+    const char* output = argc > 1 ? argv[1] : "frames.pack";
+    const char* pattern = argc > 2 ? argv[2] : "frames/frame_%04d.jpg";
+
+    frame_pack_writer* writer = NULL;
+    int width = 0, height = 0, channels = 0;
+    char filename[MAX_FILENAME_LEN];
+
+    for (int i = 0;; i++) {
+        snprintf(filename, sizeof(filename), pattern, i);
+        int w, h, c;
+        unsigned char* img = load_image(filename, &w, &h, &c);
+        if (!img) break;
+
+        if (!writer) {
+            width = w;
+            height = h;
+            channels = c;
+            writer = frame_pack_create(output, w, h, c);
+            if (!writer) return 1;
+        } else if (w != width || h != height || c != channels) {
+            log_error("%s is %dx%dx%d, expected %dx%dx%d", filename, w, h, c, width, height, channels);
+            free_image(img);
+            frame_pack_finish(writer);
+            return 1;
+        }
+
+        if (frame_pack_append(writer, img) != 0) {
+            log_error("Failed to write frame %d to %s", i, output);
+            free_image(img);
+            frame_pack_finish(writer);
+            return 1;
+        }
+        free_image(img);
+    }
+
+    if (!writer) {
+        log_error("No frames found at %s", filename);
+        return 1;
+    }
+    int count = frame_pack_finish(writer);
+    if (count < 0) {
+        log_error("Failed to finish %s", output);
+        return 1;
+    }
+    log_info("Packed %d frames of %dx%dx%d into %s", count, width, height, channels, output);
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pipeline.h"
+#include "frame_io.h"
+#include "utils.h"
+
+#define MAX_FILENAME_LEN 256
+
+// Bounded FIFO of jobs; push blocks while full, pop blocks while empty and
+// returns NULL once the queue is closed and drained
+typedef struct {
+    frame_job** items;
+    int capacity, head, count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} job_queue;
+
+static void queue_init(job_queue* q, int capacity) {
+    q->items = malloc(capacity * sizeof(frame_job*));
+    q->capacity = capacity;
+    q->head = q->count = q->closed = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_destroy(job_queue* q) {
+    free(q->items);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void queue_push(job_queue* q, frame_job* job) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->capacity) pthread_cond_wait(&q->not_full, &q->lock);
+    q->items[(q->head + q->count) % q->capacity] = job;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static frame_job* queue_pop(job_queue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed) pthread_cond_wait(&q->not_empty, &q->lock);
+    frame_job* job = NULL;
+    if (q->count > 0) {
+        job = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static void queue_close(job_queue* q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+typedef struct {
+    const pipeline_config* cfg;
+    job_queue decoded, processed;
+    frame_pool* pool;             // decoded images, returned by the compute stage
+    frame_pool* out_pool;         // edge maps, returned by the encoders; at most
+                                  // depth queued + one per encoder + one in compute
+    pthread_mutex_t lock;         // guards everything below
+    int next_index;
+    int decoders_left;
+    int saved;
+    int failed;                   // the output stream failed: stop decoding
+    double decode_time, encode_time;   // busy seconds summed over threads
+} pipeline_state;
+
+// Decode one frame; NULL (after logging) if the file cannot be loaded, or
+// at the end of the input stream
+static frame_job* decode_frame(const pipeline_config* cfg, frame_pool* pool, int index) {
+    if (cfg->input_stream) {
+        y4m_reader* in = cfg->input_stream;
+        frame_job* job = calloc(1, sizeof(frame_job));
+        job->index = index;
+        job->width = in->width;
+        job->height = in->height;
+        job->channels = 1;
+        job->img = frame_pool_get(pool, (size_t)in->width * in->height);
+        if (y4m_read_frame(in, job->img) != 1) {
+            frame_pool_put(pool, job->img);
+            free(job);
+            return NULL;
+        }
+        return job;
+    }
+
+    char input_filename[MAX_FILENAME_LEN];
+    snprintf(input_filename, sizeof(input_filename), cfg->input_pattern, index);
+
+    frame_job* job = calloc(1, sizeof(frame_job));
+    job->index = index;
+    job->img = load_image_pooled(pool, input_filename, &job->width, &job->height, &job->channels);
+    if (!job->img) {
+        log_error("%s: Failed to load %s", cfg->tag, input_filename);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+// Run the compute stage on job, into an edge map from out_pool
+static void process_job(const pipeline_config* cfg, frame_pool* out_pool, frame_job* job) {
+    job->edges = frame_pool_get(out_pool, (size_t)job->width * job->height);
+    cfg->process(job, cfg->process_arg);
+}
+
+static void release_job(frame_pool* out_pool, frame_job* job) {
+    if (!frame_pool_put(out_pool, job->edges)) free(job->edges);   // beyond the pool's buffers
+    free(job);
+}
+
+// Save job and release it; -1 if the output stream could not take the frame
+static int encode_frame(const pipeline_config* cfg, frame_pool* out_pool, edge_scratch* scratch, frame_job* job) {
+    int status = 0;
+    if (cfg->output_stream) {
+        status = y4m_write_gray(cfg->output_stream, job->edges, job->width, job->height);
+        if (status != 0) log_error("%s: Y4M output failed at frame %d; stopping", cfg->tag, job->index);
+    } else {
+        char output_filename[MAX_FILENAME_LEN];
+        edge_output_path(output_filename, sizeof(output_filename), cfg->output_pattern, job->index);
+        save_edges_scratch(scratch, cfg->output_pattern, job->index, job->edges, job->width, job->height);
+        log_info("%s: Saved %s", cfg->tag, output_filename);
+    }
+    release_job(out_pool, job);
+    return status;
+}
+
+static void log_pools(const pipeline_config* cfg, frame_pool* pool, frame_pool* out_pool) {
+    char tag[64];
+    snprintf(tag, sizeof(tag), "%s edge maps", cfg->tag);
+    frame_pool_log(pool, cfg->tag);
+    frame_pool_log(out_pool, tag);
+}
+
+static void* decoder_main(void* arg) {
+    pipeline_state* st = arg;
+    double busy = 0.0;
+
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        int index = st->next_index++;
+        int failed = st->failed;
+        pthread_mutex_unlock(&st->lock);
+        if (failed) break;
+        if (!st->cfg->input_stream && index >= st->cfg->total_frames) break;
+
+        double t0 = wall_time();
+        frame_job* job = decode_frame(st->cfg, st->pool, index);
+        busy += wall_time() - t0;
+        if (job) queue_push(&st->decoded, job);
+        else if (st->cfg->input_stream) break;
+    }
+
+    pthread_mutex_lock(&st->lock);
+    st->decode_time += busy;
+    if (--st->decoders_left == 0) queue_close(&st->decoded);
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+static void* encoder_main(void* arg) {
+    pipeline_state* st = arg;
+    double busy = 0.0;
+    int saved = 0, failed = 0;
+    edge_scratch scratch = {0};   // this encoder's packing buffer
+    frame_job* job;
+
+    // After a stream failure the rest of the queue is only released
+    while ((job = queue_pop(&st->processed)) != NULL) {
+        if (failed) {
+            release_job(st->out_pool, job);
+            continue;
+        }
+        double t0 = wall_time();
+        if (encode_frame(st->cfg, st->out_pool, &scratch, job) == 0) {
+            saved++;
+        } else {
+            failed = 1;
+            pthread_mutex_lock(&st->lock);
+            st->failed = 1;
+            pthread_mutex_unlock(&st->lock);
+        }
+        busy += wall_time() - t0;
+    }
+    edge_scratch_free(&scratch);
+
+    pthread_mutex_lock(&st->lock);
+    st->encode_time += busy;
+    st->saved += saved;
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+int pipeline_config_from_env(pipeline_config* cfg) {
+    cfg->depth = env_int("PIPELINE_DEPTH", 4);
+    cfg->decoders = env_int("PIPELINE_DECODERS", 1);
+    cfg->encoders = env_int("PIPELINE_ENCODERS", 2);
+    if (cfg->decoders < 1) cfg->decoders = 1;
+    if (cfg->encoders < 1) cfg->encoders = 1;
+
+    const char* input = env_str("Y4M_INPUT", NULL);
+    const char* output = env_str("Y4M_OUTPUT", NULL);
+    if (input && !(cfg->input_stream = y4m_open_read(input))) return -1;
+    if (output) {
+        // Keep the input's frame rate so the result lines up with the source
+        cfg->output_stream = y4m_open_write(output, cfg->input_stream ? cfg->input_stream->frame_rate : NULL);
+        if (!cfg->output_stream) return -1;
+    }
+    return 0;
+}
+
+int pipeline_close_streams(pipeline_config* cfg) {
+    int status = 0;
+    y4m_close_read(cfg->input_stream);
+    if (y4m_close_write(cfg->output_stream) != 0) {
+        log_error("%s: Failed to finish the Y4M output", cfg->tag);
+        status = -1;
+    }
+    cfg->input_stream = NULL;
+    cfg->output_stream = NULL;
+    return status;
+}
+
+int run_frame_pipeline(const pipeline_config* user_cfg) {
+    pipeline_config stream_cfg = *user_cfg;
+    const pipeline_config* cfg = &stream_cfg;
+    if (cfg->input_stream || cfg->output_stream) stream_cfg.decoders = 1;
+    if (cfg->output_stream) stream_cfg.encoders = 1;
+    if (!cfg->output_stream) edge_output_begin(cfg->output_pattern);
+
+    // Depth 0: load -> process -> save one frame at a time
+    if (cfg->depth <= 0) {
+        frame_pool* pool = frame_pool_create();
+        frame_pool* out_pool = frame_pool_create();
+        int saved = 0, failed = 0;
+        edge_scratch scratch = {0};
+        for (int i = 0; cfg->input_stream || i < cfg->total_frames; i++) {
+            frame_job* job = decode_frame(cfg, pool, i);
+            if (!job && cfg->input_stream) break;
+            if (!job) continue;
+            process_job(cfg, out_pool, job);
+            free_pooled_image(pool, job->img);
+            if (encode_frame(cfg, out_pool, &scratch, job) != 0) {
+                failed = 1;
+                break;
+            }
+            saved++;
+        }
+        log_pools(cfg, pool, out_pool);
+        frame_pool_destroy(pool);
+        frame_pool_destroy(out_pool);
+        edge_scratch_free(&scratch);
+        edge_output_end();
+        return failed ? -1 : saved;
+    }
+
+    pipeline_state st = {0};
+    st.cfg = cfg;
+    st.pool = frame_pool_create();
+    st.out_pool = frame_pool_create();
+    st.decoders_left = cfg->decoders;
+    pthread_mutex_init(&st.lock, NULL);
+    queue_init(&st.decoded, cfg->depth);
+    queue_init(&st.processed, cfg->depth);
+
+    pthread_t* threads = malloc((cfg->decoders + cfg->encoders) * sizeof(pthread_t));
+    for (int i = 0; i < cfg->decoders; i++) pthread_create(&threads[i], NULL, decoder_main, &st);
+    for (int i = 0; i < cfg->encoders; i++) pthread_create(&threads[cfg->decoders + i], NULL, encoder_main, &st);
+
+    // Compute stage runs on the calling thread (the CUDA context lives here)
+    double compute_time = 0.0;
+    frame_job* job;
+    while ((job = queue_pop(&st.decoded)) != NULL) {
+        double t0 = wall_time();
+        process_job(cfg, st.out_pool, job);
+        compute_time += wall_time() - t0;
+        free_pooled_image(st.pool, job->img);
+        job->img = NULL;
+        queue_push(&st.processed, job);
+    }
+    queue_close(&st.processed);
+
+    for (int i = 0; i < cfg->decoders + cfg->encoders; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    log_info("%s: Pipeline busy time: decode %.2fs (%d thr) | compute %.2fs | encode %.2fs (%d thr), depth %d",
+             cfg->tag, st.decode_time, cfg->decoders, compute_time, st.encode_time, cfg->encoders, cfg->depth);
+    log_pools(cfg, st.pool, st.out_pool);
+
+    queue_destroy(&st.decoded);
+    queue_destroy(&st.processed);
+    frame_pool_destroy(st.pool);
+    frame_pool_destroy(st.out_pool);
+    pthread_mutex_destroy(&st.lock);
+    edge_output_end();
+    return st.failed ? -1 : st.saved;
+}
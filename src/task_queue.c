@@ -1,37 +1,232 @@
 #include "task_queue.h"
+#include "frame_io.h"
+#include "utils.h"
 #include <dirent.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 
-void init_task_queue(TaskQueue* queue) {
-    queue->total_tasks = 0;
-    queue->current_index = 0;
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_ranges(const void* a, const void* b) {
+    return compare_ints(&((const frame_range*)a)->first, &((const frame_range*)b)->first);
+}
+
+// Append frames first..first+count-1, extending the last run when they follow it
+static void add_frames(TaskQueue* queue, int first, int count) {
+    if (count <= 0) return;
+    queue->total_tasks += count;
+
+    frame_range* last = queue->num_ranges ? &queue->ranges[queue->num_ranges - 1] : NULL;
+    if (last && last->first + last->count == first) {
+        last->count += count;
+        return;
+    }
+    if (queue->num_ranges == queue->capacity) {
+        queue->capacity = queue->capacity ? 2 * queue->capacity : 16;
+        queue->ranges = realloc(queue->ranges, queue->capacity * sizeof(frame_range));
+    }
+    queue->ranges[queue->num_ranges++] = (frame_range){ first, count };
+}
+
+// Sort the runs and merge the ones that overlap or touch, so every frame is
+// queued once and consecutive frames always share a run. Returns the number
+// of duplicate frames dropped.
+static int merge_ranges(TaskQueue* queue) {
+    if (queue->num_ranges == 0) return 0;
+    qsort(queue->ranges, queue->num_ranges, sizeof(frame_range), compare_ranges);
+
+    int kept = 0, total = 0;
+    for (int i = 0; i < queue->num_ranges; i++) {
+        frame_range r = queue->ranges[i];
+        frame_range* last = kept ? &queue->ranges[kept - 1] : NULL;
+        if (last && r.first <= last->first + last->count) {
+            long end = (long)r.first + r.count;
+            if (end > (long)last->first + last->count) last->count = (int)(end - last->first);
+        } else {
+            queue->ranges[kept++] = r;
+        }
+    }
+    queue->num_ranges = kept;
+    for (int i = 0; i < kept; i++) total += queue->ranges[i].count;
+
+    int dropped = queue->total_tasks - total;
+    queue->total_tasks = total;
+    return dropped;
+}
+
+// One manifest line: blank (0), "index" or "first-last" (1), anything else (-1)
+static int parse_manifest_line(const char* line, int* first, int* last) {
+    const char* p = line;
+    char* end;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '\0') return 0;
+
+    long a = strtol(p, &end, 10), b;
+    if (end == p) return -1;
+    p = end;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '-') {
+        b = strtol(p + 1, &end, 10);
+        if (end == p + 1) return -1;
+        p = end;
+    } else {
+        b = a;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p != '\0' || a < 0 || b < a || b > INT_MAX - 1) return -1;
+
+    *first = (int)a;
+    *last = (int)b;
+    return 1;
+}
+
+static void load_manifest(TaskQueue* queue, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        log_error("MASTER: Failed to open frame manifest %s", path);
+        return;
+    }
+
+    char line[MAX_FILENAME_LEN];
+    int line_num = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_num++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        int first, last;
+        int n = parse_manifest_line(line, &first, &last);
+        if (n > 0)
+            add_frames(queue, first, last - first + 1);
+        else if (n < 0)
+            log_error("MASTER: %s:%d: expected a frame index or first-last range; line skipped", path, line_num);
+    }
+    fclose(f);
+}
 
-    // First read all filenames
+// A frame index from the environment: fallback when unset, -1 (after
+// logging) unless the whole value is a number in 0..INT_MAX - 1
+static int env_frame(const char* name, int fallback) {
+    const char* value = env_str(name, NULL);
+    if (!value || !*value) return fallback;
+
+    char* end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < 0 || n > INT_MAX - 1) {
+        log_error("MASTER: %s=%s is not a frame index (a whole number >= 0)", name, value);
+        return -1;
+    }
+    return (int)n;
+}
+
+static void scan_frames_dir(TaskQueue* queue) {
     DIR* dir = opendir("frames/");
-    struct dirent* entry;
+    if (!dir) return;
 
+    int* frames = NULL;
+    int count = 0, capacity = 0;
+    struct dirent* entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (strstr(entry->d_name, ".jpg")) {
-            snprintf(
-                queue->filenames[queue->total_tasks],
-                MAX_FILENAME_LEN,
-                "frames/%.200s", // truncate long names
-                entry->d_name
-            );
-            queue->total_tasks++;
-            if (queue->total_tasks >= MAX_TASKS) break;
+        // Exactly frame_<n>.jpg: no suffix after the extension, no negative n
+        int frame_num, consumed = -1;
+        if (sscanf(entry->d_name, "frame_%d.jpg%n", &frame_num, &consumed) == 1 && consumed > 0 &&
+            entry->d_name[consumed] == '\0' && frame_num >= 0) {
+            if (count == capacity) {
+                capacity = capacity ? 2 * capacity : 1024;
+                frames = realloc(frames, capacity * sizeof(int));
+            }
+            frames[count++] = frame_num;
         }
     }
-
     closedir(dir);
 
-    // Sort frames numerically (assuming format frame_XXXX.jpg)
-    qsort(queue->filenames, queue->total_tasks, MAX_FILENAME_LEN, 
-        (int (*)(const void*, const void*))strcmp);
+    qsort(frames, count, sizeof(int), compare_ints);
+    for (int i = 0; i < count; i++) add_frames(queue, frames[i], 1);
+    free(frames);
+}
+
+void init_task_queue(TaskQueue* queue) {
+    memset(queue, 0, sizeof(TaskQueue));
+    queue->max_chunk = env_int("TASK_CHUNK", 16);
+    queue->min_chunk = env_int("TASK_CHUNK_MIN", 1);
+    if (queue->max_chunk < 1) queue->max_chunk = 1;
+    if (queue->min_chunk < 1) queue->min_chunk = 1;
+    if (queue->min_chunk > queue->max_chunk) queue->min_chunk = queue->max_chunk;
+
+    // A frame pack holds frames 0..count-1
+    int pack_count = frame_input_pack_count();
+    if (pack_count >= 0) {
+        add_frames(queue, 0, pack_count);
+        return;
+    }
+
+    // An invalid bound queues nothing rather than guessing the range
+    if (env_str("FRAME_LAST", NULL)) {
+        int last = env_frame("FRAME_LAST", -1);
+        int first = env_frame("FRAME_FIRST", 0);
+        if (first >= 0 && last >= 0 && first > last)
+            log_error("MASTER: FRAME_FIRST=%d is past FRAME_LAST=%d", first, last);
+        else if (first >= 0 && last >= 0)
+            add_frames(queue, first, last - first + 1);
+        return;
+    }
+
+    // Otherwise the frame numbers listed in the manifest, or those of
+    // frames/frame_XXXX.jpg; either may name a frame twice
+    const char* manifest = env_str("FRAME_MANIFEST", NULL);
+    if (manifest)
+        load_manifest(queue, manifest);
+    else
+        scan_frames_dir(queue);
+
+    int dropped = merge_ranges(queue);
+    if (dropped > 0) log_info("MASTER: Dropped %d duplicate frame(s) from the frame list", dropped);
+}
+
+void free_task_queue(TaskQueue* queue) {
+    free(queue->ranges);
+    memset(queue, 0, sizeof(TaskQueue));
+}
+
+int guided_chunk_size(int remaining, int workers, int min_chunk, int max_chunk) {
+    int size = (remaining + 2 * workers - 1) / (2 * workers);
+    if (size > max_chunk) size = max_chunk;
+    if (size < min_chunk) size = min_chunk;
+    if (size > remaining) size = remaining;
+    return size > 0 ? size : 0;
 }
 
-const char* get_next_task(TaskQueue* queue) {
-    if (queue->current_index >= queue->total_tasks) return NULL;
-    return queue->filenames[queue->current_index++];
-}
\ No newline at end of file
+int get_next_chunk(TaskQueue* queue, int workers, int* first) {
+    int remaining = queue->total_tasks - queue->current_index;
+    int size = guided_chunk_size(remaining, workers, queue->min_chunk, queue->max_chunk);
+    if (size == 0) return 0;
+
+    // A chunk never spans two runs, so its frames are always consecutive
+    const frame_range* range = &queue->ranges[queue->range_index];
+    if (size > range->count - queue->offset) size = range->count - queue->offset;
+    *first = range->first + queue->offset;
+    queue->offset += size;
+    if (queue->offset == range->count) {
+        queue->range_index++;
+        queue->offset = 0;
+    }
+    queue->current_index += size;
+    return size;
+}
+
+int task_queue_contains(const TaskQueue* queue, int frame) {
+    int lo = 0, hi = queue->num_ranges;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const frame_range* r = &queue->ranges[mid];
+        if (frame < r->first) hi = mid;
+        else if (frame - r->first >= r->count) lo = mid + 1;
+        else return 1;
+    }
+    return 0;
+}
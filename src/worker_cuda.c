@@ -1,158 +1,693 @@
 #include <mpi.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <unistd.h>  // Added for usleep
 #include "frame_io.h"
-#include "cuda_filter.h"
+#include "frame_writer.h"
+#include "edge_codec.h"
 #include "utils.h"
 
+// The same worker drives either backend: exec_full links cuda_filter.o,
+// exec_full_cpu (built with -DCPU_BACKEND) runs on nodes without a GPU
+#ifdef CPU_BACKEND
+#include "cpu_filter.h"
+#define canny_context cpu_canny_context
+#define canny_create cpu_canny_create
+#define canny_run cpu_canny_run
+#define canny_destroy cpu_canny_destroy
+#else
+#include "cuda_filter.h"
+#define canny_context cuda_canny_context
+#define canny_create cuda_canny_create
+#define canny_run cuda_canny_run
+#define canny_destroy cuda_canny_destroy
+#endif
+
 #define TAG_TASK_REQUEST 1
 #define TAG_TASK_SEND    2
 #define TAG_RESULT       3
 #define TAG_TERMINATE    4
 #define MAX_FILENAME_LEN 256
-#define EDGE_TAG 99
 
-void run_worker_cuda(int rank, int world_size) {
+// Task prefetch: while one frame is filtered and encoded, the next task is
+// already requested from the master and the frames after the current one are
+// decoding on a loader thread, which lives for the whole job and takes the
+// started slots in ring order. Only the main thread talks MPI. Tasks arrive
+// on TAG_TASK_SEND as chunks {first frame, count, prev_owner} of consecutive
+// frames, and a new chunk is only requested once the current one is all
+// loading; an empty chunk means the master has no work left.
+//
+// In segment mode (TASK_SCHEDULE=segments) every chunk is preceded by a halo
+// load of the frame before it. The halo is only run for its edges, which the
+// chunk's first frame links against, so no edges are exchanged with anyone.
+typedef struct {
+    int frame_num;
+    int halo;                  // recompute for prev_edge only; not saved
+    int prev_owner;            // first of a chunk: rank with frame_num - 1 (peer mode), else -1
+    int last_of_chunk;         // the next chunk's first frame may need these edges
+    frame_pool* pool;          // the prefetcher's, decoded into by the loader
+    int loaded;                // set by the loader under the prefetcher's lock
+    unsigned char* img;
+    int w, h, c;
+    double load_time;          // seconds the loader spent in load_image
+} prefetch_slot;
+
+typedef struct {
+    int depth;                 // frames decoding ahead of the current one (0 = no prefetch)
+    prefetch_slot* slots;      // ring of depth + 2 started loads
+    frame_pool* pool;          // decode buffers shared by the loads
+    int capacity, head, count;
+
+    // Loader thread: loads the to_load slots from load_head on; guarded by lock
+    pthread_t loader;
+    pthread_mutex_t lock;
+    pthread_cond_t work, loaded;
+    int load_head, to_load;
+    int stopping;
+
+    MPI_Request pending;       // outstanding task request, if any
+    double request_posted;     // when pending went out
+    int next_chunk[3];         // receive buffer of pending
+    int chunk_first, chunk_left;   // frames assigned but not started yet
+    int chunk_prev_owner;      // prev_owner of chunk_first, until it is started
+    int halo_mode;             // segment mode: load a halo before each chunk
+    int halos;                 // halo frames recomputed
+    int finished;              // master answered with an empty chunk
+    int requests;
+    double request_time;       // seconds from each task request to its reply being picked up
+    double request_wait;       // seconds blocked on task replies
+    double load_wait;          // seconds blocked on loader threads
+    double load_time;          // total loader busy seconds
+} task_prefetcher;
+
+static void load_frame(prefetch_slot* slot) {
+    char task[MAX_FILENAME_LEN];
+    snprintf(task, sizeof(task), frame_input_pattern(), slot->frame_num);
+    double t0 = MPI_Wtime();
+    slot->img = load_image_pooled(slot->pool, task, &slot->w, &slot->h, &slot->c);
+    slot->load_time = MPI_Wtime() - t0;
+}
+
+static void* loader_main(void* arg) {
+    task_prefetcher* p = arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->to_load == 0 && !p->stopping) pthread_cond_wait(&p->work, &p->lock);
+        if (p->to_load == 0) break;
+        prefetch_slot* slot = &p->slots[p->load_head];
+        pthread_mutex_unlock(&p->lock);
+
+        load_frame(slot);
+
+        pthread_mutex_lock(&p->lock);
+        slot->loaded = 1;
+        p->load_head = (p->load_head + 1) % p->capacity;
+        p->to_load--;
+        pthread_cond_signal(&p->loaded);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void prefetch_loader_start(task_prefetcher* p) {
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->loaded, NULL);
+    pthread_create(&p->loader, NULL, loader_main, p);
+}
+
+static void prefetch_loader_stop(task_prefetcher* p) {
+    pthread_mutex_lock(&p->lock);
+    p->stopping = 1;
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->loader, NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->loaded);
+}
+
+static void prefetch_post(task_prefetcher* p) {
+    int dummy = 0;
+    p->request_posted = MPI_Wtime();
+    MPI_Send(&dummy, 1, MPI_INT, 0, TAG_TASK_REQUEST, MPI_COMM_WORLD);
+    MPI_Irecv(p->next_chunk, 3, MPI_INT, 0, TAG_TASK_SEND, MPI_COMM_WORLD, &p->pending);
+    p->requests++;
+}
+
+static prefetch_slot* prefetch_start(task_prefetcher* p, int frame_num, int halo) {
+    prefetch_slot* slot = &p->slots[(p->head + p->count) % p->capacity];
+    slot->frame_num = frame_num;
+    slot->halo = halo;
+    slot->prev_owner = -1;
+    slot->last_of_chunk = 0;
+    slot->pool = p->pool;
+    slot->loaded = 0;
+    p->count++;
+
+    pthread_mutex_lock(&p->lock);
+    p->to_load++;
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    return slot;
+}
+
+static void prefetch_assign(task_prefetcher* p, int first, int count, int prev_owner) {
+    p->chunk_first = first;
+    p->chunk_left = count;
+    p->chunk_prev_owner = prev_owner;
+    if (p->halo_mode && first > 0) prefetch_start(p, first - 1, 1);
+}
+
+// Start loading every answered task and keep the pipeline of requests full.
+// Blocks only when there is no frame at all to work on next.
+static void prefetch_fill(task_prefetcher* p) {
+    int max_in_flight = p->depth > 0 ? p->depth + 2 : 1;
+    for (;;) {
+        // The current frame plus depth frames ahead
+        while (p->chunk_left > 0 && p->count < p->depth + 1) {
+            prefetch_slot* slot = prefetch_start(p, p->chunk_first++, 0);
+            slot->prev_owner = p->chunk_prev_owner;
+            slot->last_of_chunk = --p->chunk_left == 0;
+            p->chunk_prev_owner = -1;
+        }
+
+        if (p->pending != MPI_REQUEST_NULL) {
+            int done;
+            if (p->count == 0) {
+                double t0 = MPI_Wtime();
+                MPI_Wait(&p->pending, MPI_STATUS_IGNORE);
+                p->request_wait += MPI_Wtime() - t0;
+                done = 1;
+            } else {
+                MPI_Test(&p->pending, &done, MPI_STATUS_IGNORE);
+            }
+            if (!done) return;
+            p->request_time += MPI_Wtime() - p->request_posted;
+
+            if (p->next_chunk[1] <= 0)
+                p->finished = 1;
+            else
+                prefetch_assign(p, p->next_chunk[0], p->next_chunk[1], p->next_chunk[2]);
+            continue;
+        }
+        if (p->finished || p->chunk_left > 0 || p->count + 1 > max_in_flight) return;
+        prefetch_post(p);
+    }
+}
+
+// Oldest task, with its image loaded; NULL once the master has no work left
+static prefetch_slot* prefetch_next(task_prefetcher* p) {
+    prefetch_fill(p);
+    if (p->count == 0) return NULL;
+
+    prefetch_slot* slot = &p->slots[p->head];
+    double t0 = MPI_Wtime();
+    pthread_mutex_lock(&p->lock);
+    while (!slot->loaded) pthread_cond_wait(&p->loaded, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    p->load_wait += MPI_Wtime() - t0;
+    p->load_time += slot->load_time;
+
+    // The wait may have given the master time to answer: start that load now
+    prefetch_fill(p);
+    return slot;
+}
+
+static void prefetch_release(task_prefetcher* p) {
+    p->head = (p->head + 1) % p->capacity;
+    p->count--;
+}
+
+// Peer edge exchange (EDGE_EXCHANGE=peer). Only the last frame of a chunk
+// can be needed by another worker: its encoded edges are kept here until
+// the worker given the next chunk asks for them on TAG_PEER_REQUEST. A
+// service thread answers requests for stored frames; a request for a frame
+// still being computed is parked and answered by the main thread when the
+// frame is stored, so the service thread never blocks on a frame.
+typedef struct peer_edges {
+    int frame;
+    int width, height, size;   // size < 0: the frame failed, answered as no edges
+    unsigned char* wire;
+    int requester;             // parked request: rank waiting for frame, else -1
+    struct peer_edges* next;
+} peer_edges;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    peer_edges* entries;       // stored frames and parked requests
+    int closed;                // nothing more will be stored
+    int held, peak_held;       // stored frames
+    int served;
+    size_t served_bytes;
+} peer_store;
+
+static void peer_send(int dest, const int dims[3], const unsigned char* wire) {
+    MPI_Send(dims, 3, MPI_INT, dest, TAG_PEER_DIMS, MPI_COMM_WORLD);
+    if (dims[2] > 0) MPI_Send(wire, dims[2], MPI_UNSIGNED_CHAR, dest, TAG_PEER_DATA, MPI_COMM_WORLD);
+}
+
+// Unlink the entry for frame; caller holds the lock
+static peer_edges* peer_take(peer_store* st, int frame) {
+    for (peer_edges** e = &st->entries; *e; e = &(*e)->next) {
+        if ((*e)->frame != frame) continue;
+        peer_edges* found = *e;
+        *e = found->next;
+        return found;
+    }
+    return NULL;
+}
+
+static void peer_answer(peer_store* st, int dest, peer_edges* e) {
+    int dims[3] = {0, 0, 0};
+    if (e && e->size > 0) {
+        dims[0] = e->width;
+        dims[1] = e->height;
+        dims[2] = e->size;
+    }
+    peer_send(dest, dims, e ? e->wire : NULL);
+    pthread_mutex_lock(&st->lock);
+    st->served++;
+    st->served_bytes += dims[2];
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void* peer_service_main(void* arg) {
+    peer_store* st = arg;
+    for (;;) {
+        int frame;
+        MPI_Status status;
+        MPI_Recv(&frame, 1, MPI_INT, MPI_ANY_SOURCE, TAG_PEER_REQUEST, MPI_COMM_WORLD, &status);
+        if (frame < 0) break;   // stop, sent by peer_store_stop
+
+        pthread_mutex_lock(&st->lock);
+        peer_edges* e = peer_take(st, frame);
+        if (e) st->held--;
+        int answer = e || st->closed;
+        if (!answer) {
+            e = calloc(1, sizeof(peer_edges));
+            e->frame = frame;
+            e->requester = status.MPI_SOURCE;
+            e->next = st->entries;
+            st->entries = e;
+        }
+        pthread_mutex_unlock(&st->lock);
+
+        if (answer) {
+            peer_answer(st, status.MPI_SOURCE, e);
+            if (e) free(e->wire);
+            free(e);
+        }
+    }
+    return NULL;
+}
+
+static void peer_store_start(peer_store* st) {
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_create(&st->thread, NULL, peer_service_main, st);
+}
+
+// Keep size bytes of wire encoding for frame (size < 0 if the frame failed),
+// or send them right away if its consumer is already waiting
+static void peer_store_add(peer_store* st, int frame, int width, int height, const unsigned char* wire, int size) {
+    pthread_mutex_lock(&st->lock);
+    peer_edges* e = peer_take(st, frame);
+    if (e) {
+        pthread_mutex_unlock(&st->lock);
+        e->width = width;
+        e->height = height;
+        e->size = size;
+        e->wire = (unsigned char*)wire;
+        peer_answer(st, e->requester, e);
+        free(e);
+        return;
+    }
+    e = calloc(1, sizeof(peer_edges));
+    e->frame = frame;
+    e->width = width;
+    e->height = height;
+    e->size = size;
+    e->requester = -1;
+    if (size > 0) {
+        e->wire = malloc(size);
+        memcpy(e->wire, wire, size);
+    }
+    e->next = st->entries;
+    st->entries = e;
+    if (++st->held > st->peak_held) st->peak_held = st->held;
+    pthread_mutex_unlock(&st->lock);
+}
+
+// The next chunk came back to this rank: nobody will ask for frame
+static void peer_store_drop(peer_store* st, int frame) {
+    pthread_mutex_lock(&st->lock);
+    peer_edges* e = peer_take(st, frame);
+    if (e && e->requester < 0) st->held--;
+    pthread_mutex_unlock(&st->lock);
+    if (e) free(e->wire);
+    free(e);
+}
+
+// No more frames: parked requests and later ones get no edges
+static void peer_store_close(peer_store* st) {
+    pthread_mutex_lock(&st->lock);
+    st->closed = 1;
+    peer_edges* parked = NULL;
+    for (peer_edges** e = &st->entries; *e;) {
+        if ((*e)->requester < 0) {
+            e = &(*e)->next;
+            continue;
+        }
+        peer_edges* found = *e;
+        *e = found->next;
+        found->next = parked;
+        parked = found;
+    }
+    pthread_mutex_unlock(&st->lock);
+
+    while (parked) {
+        peer_edges* next = parked->next;
+        peer_answer(st, parked->requester, NULL);
+        free(parked);
+        parked = next;
+    }
+}
+
+// Call once no rank will send requests any more
+static void peer_store_stop(peer_store* st, int rank) {
+    int stop = -1;
+    MPI_Send(&stop, 1, MPI_INT, rank, TAG_PEER_REQUEST, MPI_COMM_WORLD);
+    pthread_join(st->thread, NULL);
+    while (st->entries) {
+        peer_edges* next = st->entries->next;
+        free(st->entries->wire);
+        free(st->entries);
+        st->entries = next;
+    }
+    pthread_mutex_destroy(&st->lock);
+}
+
+void run_worker_cuda(int rank, int world_size, int ranks_per_node) {
     int termination_received = 0;
     int dummy = 0;
-    double worker_start_time = MPI_Wtime();
     int current_frame_num = -1;
     unsigned char* prev_edge = NULL;
     int prev_width = 0, prev_height = 0;
+    size_t prev_capacity = 0;
 
-    while (!termination_received) {
-        // Debug: Worker 2 timeout check
-        if (rank == 2 && (MPI_Wtime() - worker_start_time > 10.0)) {
-            log_error("WORKER %d EMERGENCY: No termination after 10 seconds!", rank);
-            log_error("  Current state: termination_received=%d, last_frame=%d", 
-                     termination_received, current_frame_num);
-            
-            if (rank < world_size - 1) {
-                unsigned char emergency_signal = 0xFF;
-                MPI_Send(&emergency_signal, 1, MPI_UNSIGNED_CHAR, rank+1, EDGE_TAG, MPI_COMM_WORLD);
-                log_info("WORKER %d: Sent emergency signal to %d", rank, rank+1);
-            }
-            // Graceful fallback: send TERMINATE ack to master
-            MPI_Send(&dummy, 1, MPI_INT, 0, TAG_TERMINATE, MPI_COMM_WORLD);
-            log_info("WORKER %d: Sent emergency TERMINATE ack to master", rank);
+    // Scratch memory lives for the whole job; buffers grow only for larger frames
+    canny_context* ctx = canny_create(0, 0);
 
-            break;
+    // Edge maps are handed to background encoders instead of saved inline
+    frame_writer* writer = frame_writer_from_env();
+
+    // Edges travel to and from the master in the compact wire encoding
+    unsigned char* wire = NULL;
+    size_t wire_capacity = 0;
+    size_t wire_sent = 0, raw_sent = 0;
+
+#ifdef CPU_BACKEND
+    // Split each node's cores between the ranks placed on it
+    log_info("WORKER %d: CPU backend with %d thread(s)", rank, cpu_filter_init_threads(ranks_per_node));
+#endif
+
+    // WORKER_PREFETCH=N decodes up to N frames ahead (0 requests and loads
+    // each task only when the previous frame is done)
+    task_prefetcher prefetch = {0};
+    prefetch.depth = env_int("WORKER_PREFETCH", 1);
+    if (prefetch.depth < 0) prefetch.depth = 0;
+    prefetch.capacity = prefetch.depth + 2;
+    prefetch.slots = calloc(prefetch.capacity, sizeof(prefetch_slot));
+    prefetch.pool = frame_pool_create();
+    prefetch.pending = MPI_REQUEST_NULL;
+    prefetch_loader_start(&prefetch);
+    double compute_time = 0.0;
+
+    // Startup handshake with run_master: frame count, schedule and edge
+    // exchange, then this
+    // rank's first chunk (empty if there are fewer frames than workers), then
+    // the barrier. The first frame starts loading before the first task
+    // request goes out.
+    int startup[3], first_chunk[3];
+    MPI_Bcast(startup, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Scatter(NULL, 3, MPI_INT, first_chunk, 3, MPI_INT, 0, MPI_COMM_WORLD);
+    prefetch.halo_mode = startup[1];
+
+    // Peer mode: edges are fetched from and served to other workers directly
+    int peer_mode = startup[2];
+    peer_store peers = {0};
+    if (peer_mode) {
+        int level;
+        MPI_Query_thread(&level);
+        if (level < MPI_THREAD_MULTIPLE) {
+            log_error("WORKER %d: EDGE_EXCHANGE=peer without MPI_THREAD_MULTIPLE", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        peer_store_start(&peers);
+    }
 
-        // Request task
-        MPI_Send(&dummy, 1, MPI_INT, 0, TAG_TASK_REQUEST, MPI_COMM_WORLD);
-        log_info("WORKER %d: Requested new task (last frame: %d)", rank, current_frame_num);
+    if (first_chunk[1] > 0)
+        prefetch_assign(&prefetch, first_chunk[0], first_chunk[1], first_chunk[2]);
+    else
+        prefetch.finished = 1;
+    prefetch_fill(&prefetch);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double ready_time = MPI_Wtime();
+    double first_frame_time = -1.0;   // after the barrier; -1 until a frame is done
+    log_info("WORKER %d: First chunk frames %d-%d of %d", rank, first_chunk[0], first_chunk[0] + first_chunk[1] - 1, startup[0]);
 
-        // Receive task
+    while (!termination_received) {
+        // Next task, already requested and (with prefetch) loaded in the background
         MPI_Status status;
-        char task[MAX_FILENAME_LEN];
-        MPI_Recv(task, MAX_FILENAME_LEN, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        prefetch_slot* task = prefetch_next(&prefetch);
 
-        if (status.MPI_TAG == TAG_TERMINATE) {
+        if (!task) {
             log_info("WORKER %d: Received TERMINATE signal", rank);
             termination_received = 1;
-            
-            // Final edge transfer for cleanup
-            if (rank < world_size - 1) {
-                unsigned char dummy_edge = 0;
-                MPI_Send(&dummy_edge, 1, MPI_UNSIGNED_CHAR, rank+1, EDGE_TAG, MPI_COMM_WORLD);
-                log_info("WORKER %d: Sent final edge signal to %d", rank, rank+1);
-            }
-            
+
+            // Ack only once every output is on disk
+            frame_writer_flush(writer);
             MPI_Send(&dummy, 1, MPI_INT, 0, TAG_TERMINATE, MPI_COMM_WORLD);
             log_info("WORKER %d: Termination complete", rank);
             break;
         }
 
-        // Extract frame number
-        int frame_num;
-        if (sscanf(task, "frames/frame_%d.jpg", &frame_num) != 1) {
-            log_error("WORKER %d: Failed to parse frame number from %s", rank, task);
+        int frame_num = task->frame_num;
+        int prev_owner = task->prev_owner;
+        int last_of_chunk = task->last_of_chunk;
+
+        // Halo: the frame before a segment, computed here for its edges only
+        if (task->halo) {
+            int w = task->w, h = task->h, c = task->c;
+            unsigned char* img = task->img;
+            prefetch_release(&prefetch);
+            current_frame_num = -1;
+            if (!img) {
+                log_error("WORKER %d: Failed to load halo frame %d", rank, frame_num);
+                free(prev_edge);
+                prev_edge = NULL;
+                prev_capacity = 0;
+                continue;
+            }
+            if ((size_t)w * h > prev_capacity) {
+                free(prev_edge);
+                prev_capacity = (size_t)w * h;
+                prev_edge = malloc(prev_capacity);
+            }
+            double t0 = MPI_Wtime();
+            canny_run(ctx, img, prev_edge, w, h, c, NULL);
+            compute_time += MPI_Wtime() - t0;
+            free_pooled_image(prefetch.pool, img);
+            prev_width = w;
+            prev_height = h;
+            current_frame_num = frame_num;
+            prefetch.halos++;
+            log_info("WORKER %d: Recomputed halo frame %d", rank, frame_num);
             continue;
         }
         log_info("WORKER %d: Processing frame %d", rank, frame_num);
 
-        // Get previous frame's edges (if not first frame)
-        if (frame_num > 0) {
+        // Get previous frame's edges (if not first frame); segments bring
+        // their own through the halo
+        if (frame_num > 0 && !prefetch.halo_mode) {
             int expected_prev = frame_num - 1;
             if (prev_edge == NULL || expected_prev != current_frame_num) {
-                int edge_dims[2] = {0, 0};
-                int retries = 0;
-                const int max_retries = 200;  // Retry for up to 2 seconds
-        
-                while (edge_dims[0] == 0 || edge_dims[1] == 0) {
-                    log_info("WORKER %d: Requesting edges for frame %d (attempt %d)", rank, expected_prev, retries + 1);
-                    MPI_Send(&expected_prev, 1, MPI_INT, 0, TAG_EDGE_REQUEST, MPI_COMM_WORLD);
-                    MPI_Recv(edge_dims, 2, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD, &status);
-        
-                    if (edge_dims[0] == 0 || edge_dims[1] == 0) {
-                        retries++;
-                        if (retries >= max_retries) {
-                            log_error("WORKER %d: Timeout waiting for edges of frame %d — skipping temporal linking.", rank, expected_prev);
-                            break;
-                        }
-                        usleep(10000);  // wait 10ms
+                int edge_dims[3] = {0, 0, 0};   // width, height, encoded bytes
+                int source = 0, data_tag = TAG_EDGE_DATA;
+
+                if (peer_mode) {
+                    // Straight from the worker that computed it, which
+                    // answers as soon as the frame is done
+                    source = prev_owner;
+                    data_tag = TAG_PEER_DATA;
+                    if (source >= 0) {
+                        MPI_Send(&expected_prev, 1, MPI_INT, source, TAG_PEER_REQUEST, MPI_COMM_WORLD);
+                        MPI_Recv(edge_dims, 3, MPI_INT, source, TAG_PEER_DIMS, MPI_COMM_WORLD, &status);
                     }
+                } else {
+                    // The master answers once the edges are in, or as soon
+                    // as it knows none will come
+                    log_info("WORKER %d: Requesting edges for frame %d", rank, expected_prev);
+                    MPI_Send(&expected_prev, 1, MPI_INT, 0, TAG_EDGE_REQUEST, MPI_COMM_WORLD);
+                    MPI_Recv(edge_dims, 3, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD, &status);
                 }
-        
+
                 // Only receive edge data if dimensions are valid
                 if (edge_dims[0] > 0 && edge_dims[1] > 0) {
-                    if (prev_edge) free(prev_edge);
                     prev_width = edge_dims[0];
                     prev_height = edge_dims[1];
-                    prev_edge = malloc(prev_width * prev_height);
+                    if ((size_t)prev_width * prev_height > prev_capacity) {
+                        free(prev_edge);
+                        prev_capacity = (size_t)prev_width * prev_height;
+                        prev_edge = malloc(prev_capacity);
+                    }
         
-                    MPI_Recv(prev_edge, prev_width * prev_height, MPI_UNSIGNED_CHAR,
-                             0, TAG_EDGE_DATA, MPI_COMM_WORLD, &status);
+                    if ((size_t)edge_dims[2] > wire_capacity) {
+                        free(wire);
+                        wire_capacity = edge_dims[2];
+                        wire = malloc(wire_capacity);
+                    }
+                    MPI_Recv(wire, edge_dims[2], MPI_UNSIGNED_CHAR,
+                             source, data_tag, MPI_COMM_WORLD, &status);
+                    if (edge_decode(wire, edge_dims[2], prev_edge, (size_t)prev_width * prev_height) != 0) {
+                        log_error("WORKER %d: Corrupt edges for frame %d", rank, expected_prev);
+                        memset(prev_edge, 0, (size_t)prev_width * prev_height);
+                    }
         
-                    log_info("WORKER %d: Received edges for frame %d (%dx%d)",
-                             rank, expected_prev, prev_width, prev_height);
+                    log_info("WORKER %d: Received edges for frame %d (%dx%d, %d bytes)",
+                             rank, expected_prev, prev_width, prev_height, edge_dims[2]);
                 } else {
-                    if (prev_edge) {
-                        free(prev_edge);
-                        prev_edge = NULL;
-                    }
+                    free(prev_edge);
+                    prev_edge = NULL;
+                    prev_capacity = 0;
                     prev_width = prev_height = 0;
                 }
+            } else if (peer_mode && prev_owner == rank) {
+                // This rank also had the chunk before: its last edges are already here
+                peer_store_drop(&peers, expected_prev);
             }
         }
         
         
 
         // Process frame with temporal linking
-        int w, h, c;
-        unsigned char* img = load_image(task, &w, &h, &c);
+        int w = task->w, h = task->h, c = task->c;
+        unsigned char* img = task->img;
+        prefetch_release(&prefetch);
         if (!img) {
-            log_error("WORKER %d: Failed to load image: %s", rank, task);
+            log_error("WORKER %d: Failed to load image for frame %d", rank, frame_num);
+            if (peer_mode && last_of_chunk) {
+                peer_store_add(&peers, frame_num, 0, 0, NULL, -1);
+            } else if (!prefetch.halo_mode && last_of_chunk) {
+                // The next chunk's worker may be waiting on the master for these
+                int dims[3] = {0, 0, 0};
+                MPI_Send(dims, 3, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
+                MPI_Send(&frame_num, 1, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
+                MPI_Ssend(wire, 0, MPI_UNSIGNED_CHAR, 0, TAG_EDGE_DATA, MPI_COMM_WORLD);
+            }
             continue;
         }
 
-        unsigned char* output_img = malloc(w * h);
-        unsigned char* output_edges = malloc(w * h);
-        
-        cuda_canny(img, output_edges, w, h, c, prev_edge);
+        double t0 = MPI_Wtime();
+        unsigned char* output_edges = frame_writer_buffer(writer, w, h);   // back to the writer once submitted
+
+        canny_run(ctx, img, output_edges, w, h, c, prev_edge);
+        free_pooled_image(prefetch.pool, img);
         log_info("WORKER %d: Processed frame %d with temporal linking", rank, frame_num);
 
-        // Save results
-        char output_filename[MAX_FILENAME_LEN];
-        snprintf(output_filename, sizeof(output_filename), "output/output_mpi_cuda/frame_%04d.jpg", frame_num);
-        save_image(output_filename, output_edges, w, h, 1);
-        log_info("WORKER %d: Saved %s", rank, output_filename);
+        // These edges are the next frame's prev_edge, so the rest of a chunk
+        // needs nothing from the master
+        if ((size_t)w * h > prev_capacity) {
+            free(prev_edge);
+            prev_capacity = (size_t)w * h;
+            prev_edge = malloc(prev_capacity);
+        }
+        memcpy(prev_edge, output_edges, (size_t)w * h);
+        prev_width = w;
+        prev_height = h;
+
+        if (first_frame_time < 0) first_frame_time = MPI_Wtime() - ready_time;
 
-        // Send edges back to master for other workers
-        int dims[2] = {w, h};
-        MPI_Send(dims, 2, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
-        MPI_Send(task, MAX_FILENAME_LEN, MPI_CHAR, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
-        MPI_Send(output_edges, w * h, MPI_UNSIGNED_CHAR, 0, TAG_EDGE_DATA, MPI_COMM_WORLD);
-        log_info("WORKER %d: Sent edges for frame %d to master", rank, frame_num);
+        // Send edges back to master for other workers (segments need none).
+        // Only a chunk's last frame can be asked for, by the next chunk's
+        // worker; with peers it is kept here instead.
+        if (!prefetch.halo_mode && last_of_chunk) {
+            if (edge_encode_bound((size_t)w * h) > wire_capacity) {
+                free(wire);
+                wire_capacity = edge_encode_bound((size_t)w * h);
+                wire = malloc(wire_capacity);
+            }
+            int wire_size = (int)edge_encode(output_edges, (size_t)w * h, wire);
+            wire_sent += wire_size;
+            raw_sent += (size_t)w * h;
+
+            if (peer_mode) {
+                peer_store_add(&peers, frame_num, w, h, wire, wire_size);
+                log_info("WORKER %d: Kept edges for frame %d for the next chunk (%d bytes)", rank, frame_num, wire_size);
+            } else {
+                // Synchronous, so a full edge store on the master holds us
+                // here instead of piling up in MPI's buffers
+                int dims[3] = {w, h, wire_size};
+                MPI_Send(dims, 3, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
+                MPI_Send(&frame_num, 1, MPI_INT, 0, TAG_EDGE_DIMS, MPI_COMM_WORLD);
+                MPI_Ssend(wire, wire_size, MPI_UNSIGNED_CHAR, 0, TAG_EDGE_DATA, MPI_COMM_WORLD);
+                log_info("WORKER %d: Sent edges for frame %d to master (%d bytes)", rank, frame_num, wire_size);
+            }
+        }
+
+        // Save results in the background
+        char output_filename[MAX_FILENAME_LEN];
+        edge_output_path(output_filename, sizeof(output_filename), "output/output_mpi_cuda/frame_%04d", frame_num);
+        frame_writer_submit(writer, "output/output_mpi_cuda/frame_%04d", frame_num, output_edges, w, h);
+        log_info("WORKER %d: Queued %s", rank, output_filename);
+        compute_time += MPI_Wtime() - t0;
 
         // Update state
         current_frame_num = frame_num;
-        free(img);
-        free(output_img);
     }
-    
-    if (prev_edge) free(prev_edge);
+
+    // Serve peers until every worker is done asking (run_master joins the barrier)
+    if (peer_mode) {
+        peer_store_close(&peers);
+        MPI_Barrier(MPI_COMM_WORLD);
+        peer_store_stop(&peers, rank);
+        log_info("WORKER %d: Served edges %d time(s), %.1f KB; kept at most %d frame(s), %d never fetched",
+                 rank, peers.served, peers.served_bytes / 1024.0, peers.peak_held, peers.held);
+    }
+
+    char tag[32];
+    snprintf(tag, sizeof(tag), "WORKER %d", rank);
+    frame_writer_destroy(writer, tag);
+    edge_output_end();
+
+    // Hidden = work that overlapped compute instead of stalling this rank. A
+    // request is timed until its reply is picked up, so the round trip is
+    // an upper bound.
+    double load_hidden = prefetch.load_time - prefetch.load_wait;
+    double request_hidden = prefetch.request_time - prefetch.request_wait;
+    log_info("WORKER %d: Prefetch depth %d: load %.3fs, %.3fs hidden | %d task requests: round trip %.3fs, "
+             "%.3fs hidden, %.3fs waited | compute %.3fs",
+             rank, prefetch.depth, prefetch.load_time, load_hidden > 0 ? load_hidden : 0.0, prefetch.requests,
+             prefetch.request_time, request_hidden > 0 ? request_hidden : 0.0, prefetch.request_wait, compute_time);
+    frame_pool_log(prefetch.pool, tag);
+    if (prefetch.halo_mode) log_info("WORKER %d: Recomputed %d halo frame(s)", rank, prefetch.halos);
+    if (raw_sent > 0) {
+        log_info("WORKER %d: Edge %s %.1f KB encoded for %.1f KB of edge maps (%.1fx smaller)",
+                 rank, peer_mode ? "store kept" : "relay sent", wire_sent / 1024.0, raw_sent / 1024.0, (double)raw_sent / wire_sent);
+    }
+
+    // The loop only ends once the prefetcher is drained: no loads or task
+    // request are left in flight
+    prefetch_loader_stop(&prefetch);
+    free(prefetch.slots);
+    frame_pool_destroy(prefetch.pool);
+    free(wire);
+    free(prev_edge);
+    canny_destroy(ctx);
+
+    // Time to first frame, reported by run_master
+    if (first_frame_time < 0) first_frame_time = 1e30;
+    MPI_Reduce(&first_frame_time, NULL, 1, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
 }
\ No newline at end of file
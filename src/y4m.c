@@ -0,0 +1,174 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "y4m.h"
+#include "utils.h"
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_HEADER_MAX 256
+
+// Chroma subsampling of the C tag: each chroma plane is
+// ceil(width / x_div) * ceil(height / y_div) bytes
+typedef struct {
+    const char* name;
+    int planes, x_div, y_div;
+} y4m_colorspace;
+
+static const y4m_colorspace colorspaces[] = {
+    { "420jpeg",  2, 2, 2 },
+    { "420paldv", 2, 2, 2 },
+    { "420mpeg2", 2, 2, 2 },
+    { "420",      2, 2, 2 },
+    { "422",      2, 2, 1 },
+    { "444",      2, 1, 1 },
+    { "411",      2, 4, 1 },
+    { "mono",     0, 1, 1 },
+};
+#define NUM_COLORSPACES (int)(sizeof(colorspaces) / sizeof(colorspaces[0]))
+
+// Read one '\n'-terminated line (without the '\n'); -1 at EOF before any
+// byte, -2 if it does not fit
+static int read_line(FILE* f, char* line, int max) {
+    int n = 0, ch;
+    while ((ch = fgetc(f)) != EOF && ch != '\n') {
+        if (n == max - 1) return -2;
+        line[n++] = (char)ch;
+    }
+    if (ch == EOF && n == 0) return -1;
+    line[n] = '\0';
+    return n;
+}
+
+y4m_reader* y4m_open_read(const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        log_error("Failed to open Y4M stream %s", path);
+        return NULL;
+    }
+
+    char header[Y4M_HEADER_MAX];
+    if (read_line(file, header, sizeof(header)) < 0 || strncmp(header, Y4M_MAGIC " ", 10) != 0) {
+        log_error("%s is not a Y4M stream", path);
+        if (file != stdin) fclose(file);
+        return NULL;
+    }
+
+    y4m_reader* r = calloc(1, sizeof(y4m_reader));
+    r->file = file;
+    snprintf(r->frame_rate, sizeof(r->frame_rate), "30:1");
+    const y4m_colorspace* cs = &colorspaces[0];   // the spec's default
+
+    for (char* tok = strtok(header + 10, " "); tok; tok = strtok(NULL, " ")) {
+        switch (tok[0]) {
+        case 'W': r->width = atoi(tok + 1); break;
+        case 'H': r->height = atoi(tok + 1); break;
+        case 'F': snprintf(r->frame_rate, sizeof(r->frame_rate), "%s", tok + 1); break;
+        case 'C':
+            cs = NULL;
+            for (int i = 0; i < NUM_COLORSPACES && !cs; i++) {
+                if (strcmp(colorspaces[i].name, tok + 1) == 0) cs = &colorspaces[i];
+            }
+            if (!cs) {
+                log_error("%s: unsupported Y4M colorspace %s", path, tok + 1);
+                y4m_close_read(r);
+                return NULL;
+            }
+            break;
+        default: break;   // interlacing, aspect ratio and X extensions do not matter here
+        }
+    }
+    if (r->width <= 0 || r->height <= 0) {
+        log_error("%s: Y4M header has no frame size", path);
+        y4m_close_read(r);
+        return NULL;
+    }
+
+    size_t cw = (r->width + cs->x_div - 1) / cs->x_div;
+    size_t ch = (r->height + cs->y_div - 1) / cs->y_div;
+    r->chroma_bytes = cs->planes * cw * ch;
+    r->chroma = r->chroma_bytes ? malloc(r->chroma_bytes) : NULL;
+    return r;
+}
+
+int y4m_read_frame(y4m_reader* r, unsigned char* luma) {
+    char line[Y4M_HEADER_MAX];
+    int n = read_line(r->file, line, sizeof(line));
+    if (n == -1) return 0;
+    if (n < 5 || strncmp(line, "FRAME", 5) != 0) {
+        log_error("Y4M: bad frame header after frame %d", r->frames);
+        return -1;
+    }
+
+    size_t luma_bytes = (size_t)r->width * r->height;
+    if (fread(luma, 1, luma_bytes, r->file) != luma_bytes ||
+        fread(r->chroma, 1, r->chroma_bytes, r->file) != r->chroma_bytes) {
+        log_error("Y4M: truncated frame %d", r->frames);
+        return -1;
+    }
+    r->frames++;
+    return 1;
+}
+
+void y4m_close_read(y4m_reader* r) {
+    if (!r) return;
+    if (r->file != stdin) fclose(r->file);
+    free(r->chroma);
+    free(r);
+}
+
+y4m_writer* y4m_open_write(const char* path, const char* frame_rate) {
+    FILE* file;
+    if (strcmp(path, "-") == 0) {
+        // Keep the real stdout for the stream and send printf/log_info to stderr.
+        // A reader that quits early should fail the write, not kill the run.
+        signal(SIGPIPE, SIG_IGN);
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        if (file) dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+        file = fopen(path, "wb");
+    }
+    if (!file) {
+        log_error("Failed to open Y4M output %s", path);
+        return NULL;
+    }
+
+    y4m_writer* w = calloc(1, sizeof(y4m_writer));
+    w->file = file;
+    snprintf(w->frame_rate, sizeof(w->frame_rate), "%s", frame_rate ? frame_rate : "30:1");
+    return w;
+}
+
+int y4m_write_gray(y4m_writer* w, const unsigned char* gray, int width, int height) {
+    size_t chroma_bytes = 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    if (w->frames == 0) {
+        w->width = width;
+        w->height = height;
+        w->chroma = malloc(chroma_bytes);
+        memset(w->chroma, 128, chroma_bytes);
+        fprintf(w->file, Y4M_MAGIC " W%d H%d F%s Ip A1:1 C420jpeg\n", width, height, w->frame_rate);
+    } else if (width != w->width || height != w->height) {
+        log_error("Y4M: frame %d is %dx%d but the stream is %dx%d", w->frames, width, height, w->width, w->height);
+        return -1;
+    }
+
+    size_t luma_bytes = (size_t)width * height;
+    if (fputs("FRAME\n", w->file) == EOF ||
+        fwrite(gray, 1, luma_bytes, w->file) != luma_bytes ||
+        fwrite(w->chroma, 1, chroma_bytes, w->file) != chroma_bytes) {
+        log_error("Y4M: failed to write frame %d", w->frames);
+        return -1;
+    }
+    w->frames++;
+    return 0;
+}
+
+int y4m_close_write(y4m_writer* w) {
+    if (!w) return 0;
+    int status = fclose(w->file) == 0 ? 0 : -1;
+    free(w->chroma);
+    free(w);
+    return status;
+}